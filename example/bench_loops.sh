@@ -0,0 +1,30 @@
+#!/bin/sh
+# Runs newsbench against myserver with 1 up to N event loops and prints
+# the connection and request rates for each number of loops.
+#
+# Usage: bench_loops.sh [max-loops] [port]
+#
+# The programs are taken from the directory of this script unless
+# MYSERVER and NEWSBENCH are set. Extra newsbench options (e.g. -d 10)
+# can be given in NEWSBENCH_OPTIONS.
+
+dir=$(dirname "$0")
+MYSERVER=${MYSERVER:-$dir/myserver}
+NEWSBENCH=${NEWSBENCH:-$dir/newsbench}
+max=${1:-$(nproc)}
+port=${2:-7777}
+
+printf "%6s %15s %15s\n" loops connections/s requests/s
+loops=1
+while [ "$loops" -le "$max" ]; do
+    "$MYSERVER" -l "$loops" "$port" > /dev/null 2>&1 &
+    server=$!
+    sleep 1
+    result=$("$NEWSBENCH" $NEWSBENCH_OPTIONS localhost "$port")
+    kill "$server"
+    wait "$server" 2> /dev/null
+    connects=$(echo "$result" | sed -n 's/^connections\/s: //p')
+    requests=$(echo "$result" | sed -n 's/^requests\/s: //p')
+    printf "%6d %15s %15s\n" "$loops" "$connects" "$requests"
+    loops=$((loops + 1))
+done
@@ -1,9 +1,12 @@
 /* myclient.cc: sample client program */
-#include "connection.h"
 #include "connectionclosedexception.h"
+#include "newsclient.h"
 
 #include <cstdlib>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <protocol.h>
 #include <stdexcept>
 #include <string>
@@ -14,95 +17,38 @@ using std::cout;
 using std::endl;
 using std::string;
 
-void handleListNewsgroups(const Connection &conn);
-void handleCreateNewsgroup(const Connection &conn);
-void handleDeleteNewsgroup(const Connection &conn);
-void handleListArticles(const Connection &conn);
-void handleCreateArticle(const Connection &conn);
-void handleDeleteArticle(const Connection &conn);
-void handleGetArticle(const Connection &conn);
+void handleListNewsgroups(NewsClient &client);
+void handleCreateNewsgroup(NewsClient &client);
+void handleDeleteNewsgroup(NewsClient &client);
+void handleListArticles(NewsClient &client);
+void handleCreateArticle(NewsClient &client);
+void handleDeleteArticle(NewsClient &client);
+void handleGetArticle(NewsClient &client);
 void handleEnd();
-void expect(const Connection &conn, Protocol expected);
 int getId();
 
 /*
- * Send an integer to the server as four bytes.
+ * Sends the requests and waits for the answer to the last one. Exits
+ * if the server does not answer properly.
  */
-void writeNumber(const Connection &conn, int value) {
-    conn.write((value >> 24) & 0xFF);
-    conn.write((value >> 16) & 0xFF);
-    conn.write((value >> 8) & 0xFF);
-    conn.write(value & 0xFF);
-}
-
-/*
- * Read a number from the server.
- */
-int readNumberParam(const Connection &conn) {
-    expect(conn, Protocol::PAR_NUM);
-    unsigned char byte1 = conn.read();
-    unsigned char byte2 = conn.read();
-    unsigned char byte3 = conn.read();
-    unsigned char byte4 = conn.read();
-    return (byte1 << 24) | (byte2 << 16) | (byte3 << 8) | byte4;
-}
-
-int readNumber(const Connection &conn) {
-    unsigned char byte1 = conn.read();
-    unsigned char byte2 = conn.read();
-    unsigned char byte3 = conn.read();
-    unsigned char byte4 = conn.read();
-    return (byte1 << 24) | (byte2 << 16) | (byte3 << 8) | byte4;
-}
-
-/*
- * Send a command to the server.
- */
-void writeCommand(const Connection &conn, Protocol command) {
-    conn.write(static_cast<unsigned char>(command));
-}
-
-/*
- * Send a string parameter to the server.
- */
-void writeStringParam(const Connection &conn, const string &s) {
-    conn.write(static_cast<unsigned char>(Protocol::PAR_STRING));
-    writeNumber(conn, s.size());
-    for (char c : s) {
-        conn.write(c);
-    }
-}
-
-/*
- * Send a number parameter to the server.
- */
-void writeNumberParam(const Connection &conn, int value) {
-    conn.write(static_cast<unsigned char>(Protocol::PAR_NUM));
-    writeNumber(conn, value);
-}
-
-/*
- * Read a string from the server.
- */
-string readStringParam(const Connection &conn) {
-    expect(conn, Protocol::PAR_STRING);
-    int length = readNumber(conn);
-    string s;
-    for (int i = 0; i < length; i++) {
-        s += static_cast<char>(conn.read());
+template <typename T>
+T await(NewsClient &client, std::future<T> answer) {
+    try {
+        client.flush();
+        return answer.get();
+    } catch (ConnectionClosedException &) {
+        cerr << "No reply from server. Exiting." << endl;
+        exit(1);
+    } catch (std::runtime_error &e) {
+        cerr << "Error: " << e.what() << endl;
+        exit(1);
     }
-    return s;
 }
 
-Protocol readProtocol(const Connection &conn) {
-    unsigned char byte = conn.read();
-    return static_cast<Protocol>(byte);
-}
-
-/* Creates a client for the given args, if possible.
+/* Checks the args and parses the port number, if possible.
  * Otherwise exits with error code.
  */
-Connection init(int argc, char *argv[]) {
+int init(int argc, char *argv[]) {
     if (argc != 3) {
         cerr << "Usage: myclient host-name port-number" << endl;
         exit(1);
@@ -115,14 +61,7 @@ Connection init(int argc, char *argv[]) {
         cerr << "Wrong port number. " << e.what() << endl;
         exit(2);
     }
-
-    Connection conn(argv[1], port);
-    if (!conn.isConnected()) {
-        cerr << "Connection attempt failed" << endl;
-        exit(3);
-    }
-
-    return conn;
+    return port;
 }
 
 // COM_LIST_NG = 1,    // list newsgroups
@@ -133,7 +72,7 @@ Connection init(int argc, char *argv[]) {
 // COM_DELETE_ART = 6, // delete article
 // COM_GET_ART = 7,    // get article
 
-int app(const Connection &conn) {
+int app(NewsClient &client) {
     cout << "\n--------------------------------------------------------------------------------\n"
             "Hello and welcome to the application!\n"
             "To interact with the app please chose the action you want to take by typing a single number followed by return\n\n"
@@ -176,29 +115,27 @@ int app(const Connection &conn) {
             continue;
         }
 
-        Protocol command = static_cast<Protocol>(nbr);
-        writeCommand(conn, command);
-        switch (command) {
+        switch (static_cast<Protocol>(nbr)) {
         case Protocol::COM_LIST_NG:
-            handleListNewsgroups(conn);
+            handleListNewsgroups(client);
             break;
         case Protocol::COM_CREATE_NG:
-            handleCreateNewsgroup(conn);
+            handleCreateNewsgroup(client);
             break;
         case Protocol::COM_DELETE_NG:
-            handleDeleteNewsgroup(conn);
+            handleDeleteNewsgroup(client);
             break;
         case Protocol::COM_LIST_ART:
-            handleListArticles(conn);
+            handleListArticles(client);
             break;
         case Protocol::COM_CREATE_ART:
-            handleCreateArticle(conn);
+            handleCreateArticle(client);
             break;
         case Protocol::COM_DELETE_ART:
-            handleDeleteArticle(conn);
+            handleDeleteArticle(client);
             break;
         case Protocol::COM_GET_ART:
-            handleGetArticle(conn);
+            handleGetArticle(client);
             break;
         case Protocol::COM_END:
             handleEnd();
@@ -212,216 +149,129 @@ int app(const Connection &conn) {
     return 0;
 }
 
-int main(int argc, char *argv[]) {
-    Connection conn = init(argc, argv);
-    return app(conn);
+/* Connects to the server, or exits if that fails */
+std::unique_ptr<NewsClient> connect(const char *host, int port) {
+    auto client = std::make_unique<NewsClient>(host, port);
+    if (!client->isConnected()) {
+        cerr << "Connection attempt failed" << endl;
+        exit(3);
+    }
+    return client;
 }
 
-void handleListNewsgroups(const Connection &conn) {
-    writeCommand(conn, Protocol::COM_END);
-    expect(conn, Protocol::ANS_LIST_NG);
+int main(int argc, char *argv[]) {
+    int port = init(argc, argv);
+    auto client = connect(argv[1], port);
+    /* Servers that do not know COM_HELLO close the connection; the
+       client then connects again and uses the original protocol */
     try {
-        int numberOfNewsgroups = readNumberParam(conn);
-        for (int i = 0; i < numberOfNewsgroups; i++) {
-            int id = readNumberParam(conn);
-            string name = readStringParam(conn);
-            cout << "Newsgroup " << id << ": " << name << endl;
-        }
+        auto agreed = client->hello(feature::pagination);
+        client->flush();
+        agreed.get();
     } catch (ConnectionClosedException &) {
-        cout << "No reply from server. Exiting." << endl;
-        exit(1);
+        client = connect(argv[1], port);
+    } catch (std::runtime_error &) {
+        client = connect(argv[1], port);
+    }
+    return app(*client);
+}
+
+void handleListNewsgroups(NewsClient &client) {
+    for (auto &group : await(client, client.listNewsgroups())) {
+        cout << "Newsgroup " << group.first << ": " << group.second << endl;
     }
-    expect(conn, Protocol::ANS_END);
 }
 
-void handleCreateNewsgroup(const Connection &conn) {
+void handleCreateNewsgroup(NewsClient &client) {
     string name;
     cout << "Enter name of newsgroup: ";
     getline(cin, name);
-    writeStringParam(conn, name);
-    writeCommand(conn, Protocol::COM_END);
-
-    expect(conn, Protocol::ANS_CREATE_NG);
-    try {
-        Protocol body = readProtocol(conn);
-        switch (body) {
-        case Protocol::ANS_NAK:
-            expect(conn, Protocol::ERR_NG_ALREADY_EXISTS);
-            cerr << "Error: Newsgroup already exists" << endl;
-            break;
-        case Protocol::ANS_ACK:
-            cout << "Newsgroup created" << endl;
-            break;
-        default:
-            cerr << "Error: Unexpected answer " << static_cast<int>(body) << endl;
-            exit(1);
-        }
-        expect(conn, Protocol::ANS_END);
-    } catch (const ConnectionClosedException &) {
-        cerr << "No reply from server. Exiting." << endl;
-        exit(1);
+    if (await(client, client.createNewsgroup(name))) {
+        cout << "Newsgroup created" << endl;
+    } else {
+        cerr << "Error: Newsgroup already exists" << endl;
     }
 }
 
-void handleDeleteNewsgroup(const Connection &conn) {
+void handleDeleteNewsgroup(NewsClient &client) {
     cout << "Enter id of newsgroup: ";
     int id = getId();
-    writeNumberParam(conn, id);
-    writeCommand(conn, Protocol::COM_END);
-
-    expect(conn, Protocol::ANS_DELETE_NG);
-    Protocol body = readProtocol(conn);
-    switch (body) {
-    case Protocol::ANS_NAK:
-        expect(conn, Protocol::ERR_NG_DOES_NOT_EXIST);
-        cerr << "Error: Newsgroup does not exist" << endl;
-        break;
-    case Protocol::ANS_ACK:
+    if (await(client, client.deleteNewsgroup(id))) {
         cout << "Newsgroup deleted" << endl;
-        break;
-    default:
-        cerr << "Error: Unexpected answer " << static_cast<int>(body) << endl;
-        exit(1);
+    } else {
+        cerr << "Error: Newsgroup does not exist" << endl;
     }
-    expect(conn, Protocol::ANS_END);
 }
 
-void handleListArticles(const Connection &conn) {
+void handleListArticles(NewsClient &client) {
     cout << "Enter id of newsgroup: ";
     int groupId = getId();
-    writeNumberParam(conn, groupId);
-    writeCommand(conn, Protocol::COM_END);
-
-    expect(conn, Protocol::ANS_LIST_ART);
-    int numberOfArticles;
-    int id;
-    try {
-        Protocol body = readProtocol(conn);
-        switch (body) {
-        case Protocol::ANS_NAK:
-            expect(conn, Protocol::ERR_NG_DOES_NOT_EXIST);
+    /* Large newsgroups are listed a page at a time, if the server agreed */
+    bool paged = (client.features() & feature::pagination) != 0;
+    const std::size_t page_size = 100;
+    std::optional<int> after;
+    while (true) {
+        auto articles = await(client, paged ? client.listArticles(groupId, after, page_size)
+                                            : client.listArticles(groupId));
+        if (!articles.has_value()) {
             cout << "Error: Newsgroup does not exist" << endl;
-            break;
-        case Protocol::ANS_ACK:
-            numberOfArticles = readNumberParam(conn);
-            for (int i = 0; i < numberOfArticles; i++) {
-                id = readNumberParam(conn);
-                string title = readStringParam(conn);
-                cout << "Article " << id << ": " << title << endl;
-            }
-            break;
-        default:
-            cerr << "Error: Unexpected answer " << static_cast<int>(body) << endl;
-            exit(1);
+            return;
         }
-    } catch (ConnectionClosedException &) {
-        cout << "No reply from server. Exiting." << endl;
-        return;
+        for (auto &article : *articles) {
+            cout << "Article " << article.first << ": " << article.second << endl;
+        }
+        if (!paged || articles->size() < page_size) {
+            return;
+        }
+        after = articles->back().first;
     }
-    expect(conn, Protocol::ANS_END);
 }
 
-void handleCreateArticle(const Connection &conn) {
+void handleCreateArticle(NewsClient &client) {
     string title, author, text;
     cout << "Enter id of newsgroup: ";
     int groupId = getId();
-    writeNumberParam(conn, groupId);
     cout << "Enter title of article: ";
     std::getline(cin, title);
-    writeStringParam(conn, title);
     cout << "Enter author of article: ";
     std::getline(cin, author);
-    writeStringParam(conn, author);
     cout << "Enter text of article: ";
     std::getline(cin, text);
-    writeStringParam(conn, text);
-    writeCommand(conn, Protocol::COM_END);
-
-    expect(conn, Protocol::ANS_CREATE_ART);
-    Protocol body = readProtocol(conn);
-    switch (body) {
-    case Protocol::ANS_NAK:
-        cout << "Error: Newsgroup does not exist" << endl;
-        break;
-    case Protocol::ANS_ACK:
+    if (await(client, client.createArticle(groupId, title, author, text))) {
         cout << "Article created" << endl;
-        break;
-    default:
-        cout << "Error: Unexpected answer " << static_cast<int>(body) << endl;
-        break;
+    } else {
+        cout << "Error: Newsgroup does not exist" << endl;
     }
-    expect(conn, Protocol::ANS_END);
 }
 
-void handleDeleteArticle(const Connection &conn) {
+void handleDeleteArticle(NewsClient &client) {
     cout << "Enter id of newsgroup: ";
     int groupId = getId();
-    writeNumberParam(conn, groupId);
     cout << "Enter id of article: ";
     int id = getId();
-    writeNumberParam(conn, id);
-    writeCommand(conn, Protocol::COM_END);
-
-    expect(conn, Protocol::ANS_DELETE_ART);
-    Protocol body = readProtocol(conn);
-    switch (body) {
-    case Protocol::ANS_NAK:
-        cout << "Error: Newsgroup does not exist" << endl;
-        break;
-    case Protocol::ANS_ACK:
+    if (await(client, client.deleteArticle(groupId, id))) {
         cout << "Article deleted" << endl;
-        break;
-    default:
-        cout << "Error: Unexpected answer " << static_cast<int>(body) << endl;
-        exit(1);
+    } else {
+        cout << "Error: Newsgroup or article does not exist" << endl;
     }
-    expect(conn, Protocol::ANS_END);
 }
 
-void handleGetArticle(const Connection &conn) {
+void handleGetArticle(NewsClient &client) {
     cout << "Enter id of newsgroup: ";
     int groupId = getId();
-    writeNumberParam(conn, groupId);
     cout << "Enter id of article: ";
     int id = getId();
-    writeNumberParam(conn, id);
-    writeCommand(conn, Protocol::COM_END);
-
-    Protocol errorCode;
-    string title, author, text;
-    expect(conn, Protocol::ANS_GET_ART);
-    Protocol body = readProtocol(conn);
-    switch (body) {
-    case Protocol::ANS_NAK:
-        errorCode = readProtocol(conn);
-        if (errorCode == Protocol::ERR_NG_DOES_NOT_EXIST) {
-            cerr << "Error: Newsgroup does not exist" << endl;
-        } else if (errorCode == Protocol::ERR_ART_DOES_NOT_EXIST) {
-            cerr << "Error: Article does not exist" << endl;
-        } else {
-            cerr << "Error: Unexpected answer " << static_cast<int>(errorCode) << endl;
-            exit(1);
-        }
-        break;
-    case Protocol::ANS_ACK:
-        title = readStringParam(conn);
-        author = readStringParam(conn);
-        text = readStringParam(conn);
-        cout << "Article retrieved:\n";
-        cout << "Title: " << title << "\n";
-        cout << "Author: " << author << "\n";
-        cout << "Text:\n"
-             << text << "\n";
-        break;
-    default:
-        cout << "Error: Unexpected answer " << static_cast<int>(body) << endl;
-        exit(1);
-    }
-    Protocol end = readProtocol(conn);
-    if (end != Protocol::ANS_END) {
-        cout << "Error: Expected answer ANS_END, got " << static_cast<int>(end) << endl;
+    auto article = await(client, client.getArticle(groupId, id));
+    if (!article.has_value()) {
+        cerr << "Error: Newsgroup or article does not exist" << endl;
         return;
     }
+    auto &[title, author, text] = *article;
+    cout << "Article retrieved:\n";
+    cout << "Title: " << title << "\n";
+    cout << "Author: " << author << "\n";
+    cout << "Text:\n"
+         << text << "\n";
 }
 
 void handleEnd() {
@@ -430,14 +280,6 @@ void handleEnd() {
     exit(0);
 }
 
-void expect(const Connection &conn, Protocol expected) {
-    Protocol actual = readProtocol(conn);
-    if (actual != expected) {
-        cerr << "Error: Expected answer " << static_cast<int>(expected) << ", got " << static_cast<int>(actual) << endl;
-        exit(1);
-    }
-}
-
 int getId() {
     int number;
     string input;
@@ -3,13 +3,26 @@
 #include "connectionclosedexception.h"
 #include "server.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <deque>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <tuple>
+#include <type_traits>
+#include <utility>
+#include <pthread.h> /* pthread_setaffinity_np() */
+#include <sched.h>   /* cpu_set_t */
+#include <sys/socket.h> /* shutdown() */
+#include <unistd.h>  /* getopt() */
 
 using std::string;
 using std::cout;
@@ -19,237 +32,583 @@ using std::endl;
 using std::string;
 using std::uint8_t;
 
+#include "ConcurrentInMemoryDatabase.h"
 #include "InMemoryDatabase.h"
 #include "DiskDatabase.h"
+#include "SynchronizedDatabase.h"
+#include "asyncconnection.h"
+#include "commanddecoder.h"
 #include "protocol.h"
+#include "protocolcodec.h"
+#include "replybuilder.h"
+#include "task.h"
+#include "threadpool.h"
+#include "uringserver.h"
 #include <command.h>
 
-InMemoryDatabase db = InMemoryDatabase();
-// DiskDatabase db = DiskDatabase("db");
+/* The protocol features this server offers in the COM_HELLO handshake */
+constexpr int server_features =
+    feature::batch | feature::pagination | feature::compression | feature::conditional;
 
-void writeCommand(const std::shared_ptr<Connection> &conn, Protocol command);
+/* The other databases are not thread safe on their own */
+ConcurrentInMemoryDatabase db;
+// InMemoryDatabase backend = InMemoryDatabase();
+// DiskDatabase backend = DiskDatabase("db");
+// SynchronizedDatabase db(backend);
 
-int readNumber(const std::shared_ptr<Connection> &conn) {
-    unsigned char byte1 = conn->read();
-    unsigned char byte2 = conn->read();
-    unsigned char byte3 = conn->read();
-    unsigned char byte4 = conn->read();
-    return (byte1 << 24) | (byte2 << 16) | (byte3 << 8) | byte4;
-}
+/*
+ * A client connection together with its partly received command and the
+ * commands that have been read but not yet answered. At most one worker
+ * runs the commands of a connection at a time, in arrival order, so the
+ * answers are sent in the same order as the commands.
+ *
+ * A worker blocks while a slow client reads its answer, so the commands
+ * that keep arriving are bounded: reading from the client pauses while
+ * too many commands are pending or too large an answer is being sent,
+ * and the worker resumes it when the connection has drained.
+ */
+class ClientConnection : public Connection {
+public:
+    CommandDecoder decoder;
+    std::mutex mutex;
+    std::deque<Command> pending;
+    bool running = false;
+    ReplyBuilder reply;
 
-void writeParNumber(const std::shared_ptr<Connection> &conn, int value) {
-    writeCommand(conn, Protocol::PAR_NUM);
-    cout << "Writing number " << value << endl;
-    conn->write((value >> 24) & 0xFF);
-    conn->write((value >> 16) & 0xFF);
-    conn->write((value >> 8) & 0xFF);
-    conn->write(value & 0xFF);
-}
+    /* True while the event loop does not read from the client. Guarded
+       by mutex, like pending and running */
+    bool reading_paused = false;
 
-void writeNumber(const std::shared_ptr<Connection> &conn, int value) {
-    cout << "Writing number " << value << endl;
-    conn->write((value >> 24) & 0xFF);
-    conn->write((value >> 16) & 0xFF);
-    conn->write((value >> 8) & 0xFF);
-    conn->write(value & 0xFF);
-}
+    /* Limits on the work queued for a connection. Reading pauses while
+       command_limit commands are pending, while an answer of more than
+       high_water bytes is being sent, or while the answers being sent
+       to all connections together exceed total_limit. It is resumed
+       when at most command_limit / 4 commands and low_water answer
+       bytes are left */
+    static constexpr std::size_t command_limit{64};
+    static constexpr std::size_t low_water{16 * 1024};
+    static constexpr std::size_t high_water{256 * 1024};
+    static std::size_t total_limit;
+
+    ~ClientConnection() override { total_output -= output; }
+
+    /* Counts 'size' bytes of answer as being sent to the client, until
+       the next call */
+    void setOutput(std::size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        total_output += size;
+        total_output -= output;
+        output = size;
+    }
+
+    /* True if reading should pause, or may resume. Called with mutex
+       held */
+    bool overloaded() const {
+        return pending.size() >= command_limit || output > high_water ||
+               (output > 0 && total_output > total_limit);
+    }
+    bool drained() const {
+        return pending.size() <= command_limit / 4 &&
+               (output == 0 || (output <= low_water && total_output <= total_limit));
+    }
+
+    /* Shuts the socket down, so that the event loop sees the client as
+       gone and deregisters the connection */
+    void shutdown() const { ::shutdown(my_socket, SHUT_RDWR); }
+
+private:
+    /* Answer bytes being sent to all connections, and the part of it
+       that is this connection's, which is guarded by mutex */
+    static std::atomic<std::size_t> total_output;
+    std::size_t output = 0;
+};
+
+std::size_t ClientConnection::total_limit{256 * 1024 * 1024};
+std::atomic<std::size_t> ClientConnection::total_output{0};
 
 /*
- * Read an integer from a client.
+ * Command line options.
  */
-Command readCommand(const std::shared_ptr<Connection> &conn){
-    Protocol commandType = static_cast<Protocol>(conn->read());
-    cout << "Command type: " << static_cast<int>(commandType) << "\n";
-    
-    std::vector<Param> params;
-    try {
-        unsigned char byte;
-        while((byte = conn->read()) != static_cast<unsigned char>(Protocol::COM_END)) {
-            Protocol paramType = static_cast<Protocol>(byte);
-            if (paramType == Protocol::PAR_STRING) {
-                int length = readNumber(conn);
-                string paramValue;
-                for (unsigned char i = 0; i < length; i++) {
-                    paramValue += static_cast<char>(conn->read());
-                }
-                params.push_back(Param(paramType, paramValue));
-            } else if (paramType == Protocol::PAR_NUM) {
-                int paramValue = readNumber(conn);
-                params.push_back(Param(paramType, paramValue));
-            } else {
-                cout << "Parameter type: " << static_cast<int>(paramType) << "\n";
-                throw std::runtime_error("Unknown parameter type");
-            }
-        }
-        
-    } catch (const ConnectionClosedException&) {
-        throw; // Rethrow to handle disconnection at a higher level
-    }
-    return Command(commandType, params);
+struct Options {
+    int port = -1;
+    std::size_t workers = std::thread::hardware_concurrency();
+    int backlog = Server::default_backlog;
+    int loops = 1;
+    bool uring = false;
+    bool coroutines = false;
+    std::size_t output_limit = 256;
+};
+
+void usage() {
+    cerr << "Usage: myserver [-e epoll|uring] [-c] [-m output-MiB] [-l event-loops] [-w worker-threads] [-b backlog] port-number" << endl;
+    exit(1);
 }
 
 /*
- * Send a string to a client.
+ * Parses a positive number given to option 'name'.
  */
-void writeParString(const std::shared_ptr<Connection> &conn, const string &s) {
-    writeCommand(conn, Protocol::PAR_STRING);
-    writeNumber(conn, s.size());
-    cout << "Writing string " << s << endl;
-    for (char c : s) {
-        conn->write(c);
+int positive_number(const char *arg, const char *name) {
+    try {
+        int value = std::stoi(arg);
+        if (value > 0) {
+            return value;
+        }
+    } catch (std::exception &) {
     }
+    cerr << "Wrong format for " << name << "." << endl;
+    exit(2);
 }
 
-void writeCommand(const std::shared_ptr<Connection> &conn, Protocol command) {
-    cout << "Sending command: " << static_cast<int>(command) << "\n";
-    conn->write(static_cast<unsigned char>(command));
-}
-
-Server init(int argc, char *argv[]) {
-    if (argc != 2) {
-        cerr << "Usage: myserver port-number" << endl;
-        exit(1);
+Options parse_options(int argc, char *argv[]) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "e:cm:l:w:b:")) != -1) {
+        switch (opt) {
+        case 'e':
+            if (string(optarg) == "uring") {
+                options.uring = true;
+            } else if (string(optarg) != "epoll") {
+                usage();
+            }
+            break;
+        case 'c':
+            options.coroutines = true;
+            break;
+        case 'm':
+            options.output_limit = positive_number(optarg, "output limit");
+            break;
+        case 'l':
+            options.loops = positive_number(optarg, "number of event loops");
+            break;
+        case 'w':
+            options.workers = positive_number(optarg, "number of worker threads");
+            break;
+        case 'b':
+            options.backlog = positive_number(optarg, "backlog");
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
     }
 
-    int port = -1;
     try {
-        port = std::stoi(argv[1]);
+        options.port = std::stoi(argv[optind]);
     } catch (std::exception &e) {
         cerr << "Wrong format for port number. " << e.what() << endl;
         exit(2);
     }
+    return options;
+}
+
+Task handle_client(AsyncConnection &conn);
 
-    Server server(port);
-    if (!server.isReady()) {
+std::unique_ptr<Server> init(const Options &options) {
+    std::unique_ptr<Server> server;
+    if (options.uring) {
+        server = std::make_unique<UringServer>(options.port, options.backlog, options.loops > 1);
+        if (!server->isReady()) {
+            cerr << "io_uring is not available, using epoll." << endl;
+            server = nullptr;
+        }
+    }
+    if (server == nullptr) {
+        server = std::make_unique<Server>(options.port, options.backlog, options.loops > 1);
+    }
+    if (!server->isReady()) {
         cerr << "Server initialization error." << endl;
         exit(3);
     }
+    if (options.coroutines) {
+        server->setConnectionFactory([] {
+            cout << "New client connects" << endl;
+            return std::make_shared<AsyncConnection>(handle_client);
+        });
+    } else {
+        server->setConnectionFactory([] {
+            cout << "New client connects" << endl;
+            return std::make_shared<ClientConnection>();
+        });
+    }
     return server;
 }
 
-void process_request(std::shared_ptr<Connection> &conn) {
-    Command command = readCommand(conn);
-    bool result;
-    bool result1;
-    bool result2;
-    bool result3;
-    std::vector<std::pair<int, string>> result4;
-    std::vector<std::pair<int, string>> result5;
-    std::tuple<bool, string, string, string> result6;
-    std::optional<std::vector<std::pair<int, string>>> articlesOpt;
+/*
+ * Throws if the client has not agreed on a feature that a command needs,
+ * so the connection is closed as if the command were unknown.
+ */
+void require_feature(const Connection &conn, int wanted) {
+    if ((conn.getFeatures() & wanted) == 0) {
+        throw std::runtime_error("Feature " + std::to_string(wanted) + " has not been agreed on");
+    }
+}
+
+/*
+ * The error code for an article that the database did not find.
+ */
+Protocol article_error(Database::ArticleStatus status) {
+    return status == Database::ArticleStatus::NoNewsgroup ? Protocol::ERR_NG_DOES_NOT_EXIST
+                                                          : Protocol::ERR_ART_DOES_NOT_EXIST;
+}
 
+/*
+ * Calls encode with the title, author and text of an article, or with a
+ * codec::Nak if there is no such article. Article texts stored in files
+ * are sent straight from the file, unless they are to be compressed; the
+ * file is then added to open_files.
+ */
+template <typename Encode>
+void fetch_article(const Connection &conn, int groupId, int articleId, std::vector<ArticleFile> &open_files,
+                   Encode encode) {
+    std::optional<ArticleFile> articleFile;
+    if ((conn.getFeatures() & feature::compression) == 0) {
+        articleFile = db.getArticleFile(groupId, articleId);
+    }
+    if (articleFile.has_value()) {
+        ReplyBuilder::FileRange text{articleFile->fd, articleFile->offset, articleFile->length};
+        encode(std::optional(std::tie(articleFile->title, articleFile->author, text)));
+        open_files.push_back(std::move(*articleFile));
+        return;
+    }
+    auto [status, title, author, text] = db.getArticle(groupId, articleId);
+    if (status != Database::ArticleStatus::Found) {
+        encode(codec::Nak{article_error(status)});
+        return;
+    }
+    encode(std::optional(std::tuple(std::move(title), std::move(author), std::move(text))));
+}
+
+/*
+ * Appends the answer to a command to reply. Article files that are sent
+ * from the file are added to open_files, since they must stay open until
+ * the reply has been written.
+ */
+void encode_answer(const Connection &conn, ReplyBuilder &reply, Command &command, std::vector<ArticleFile> &open_files) {
+    /* The parameters and answers are laid out by the schema in protocol.h */
     switch (command.commandType) {
         case Protocol::COM_LIST_NG:
-            result4 = db.listNewsgroups();
-            writeCommand(conn, Protocol::ANS_LIST_NG);
-            writeParNumber(conn, result4.size());
-            for (auto &ng : result4) {
-                writeParNumber(conn, ng.first);
-                writeParString(conn, ng.second);
-            }
-            writeCommand(conn, Protocol::ANS_END);
+            codec::encodeAnswer<schema::ListNewsgroups>(reply, *db.newsgroupListing());
             break;
-        case Protocol::COM_CREATE_NG:
-            result = db.createNewsgroup(command.parameters[0].getString());
-            writeCommand(conn, Protocol::ANS_CREATE_NG);
-            if (result == 1) {
-                writeCommand(conn, Protocol::ANS_ACK);
-            } else {
-                writeCommand(conn, Protocol::ANS_NAK);
-                writeCommand(conn, Protocol::ERR_NG_ALREADY_EXISTS); 
-            }
-            writeCommand(conn, Protocol::ANS_END);
+        case Protocol::COM_CREATE_NG: {
+            auto [name] = codec::decodeRequest<schema::CreateNewsgroup>(command);
+            codec::encodeAnswer<schema::CreateNewsgroup>(reply, db.createNewsgroup(name));
             break;
-        case Protocol::COM_DELETE_NG:
-            result1 = db.deleteNewsgroup(command.parameters[0].getInt());
-            writeCommand(conn, Protocol::ANS_DELETE_NG);
-            if (result1 == 1) {
-                writeCommand(conn, Protocol::ANS_ACK);
-            } else {
-                writeCommand(conn, Protocol::ANS_NAK);
-                writeCommand(conn, Protocol::ERR_NG_DOES_NOT_EXIST); 
-            }
-            writeCommand(conn, Protocol::ANS_END);
-            break;
-        case Protocol::COM_LIST_ART:
-            articlesOpt = db.listArticles(command.parameters[0].getInt());
-            writeCommand(conn, Protocol::ANS_LIST_ART);
-            if (!articlesOpt.has_value()) {
-                writeCommand(conn, Protocol::ANS_NAK);
-                writeCommand(conn, Protocol::ERR_NG_DOES_NOT_EXIST); 
+        }
+        case Protocol::COM_DELETE_NG: {
+            auto [id] = codec::decodeRequest<schema::DeleteNewsgroup>(command);
+            codec::encodeAnswer<schema::DeleteNewsgroup>(reply, db.deleteNewsgroup(id));
+            break;
+        }
+        case Protocol::COM_LIST_ART: {
+            /* With a limit, and optionally the id to start after, only a
+               page of the list is sent */
+            auto [groupId, limit, after] = codec::decodeRequest<schema::ListArticles>(command);
+            if (limit.has_value()) {
+                require_feature(conn, feature::pagination);
+                codec::encodeAnswer<schema::ListArticles>(reply, db.listArticles(groupId, after, std::max(0, *limit)));
             } else {
-                writeCommand(conn, Protocol::ANS_ACK);
-                const auto &articles = articlesOpt.value();
-                writeParNumber(conn, static_cast<int>(articles.size()));
-                for (auto &art : articles) {
-                    writeParNumber(conn, art.first);
-                    writeParString(conn, art.second);
-                }
+                codec::encodeAnswer<schema::ListArticles>(reply, db.articleListing(groupId));
             }
-            writeCommand(conn, Protocol::ANS_END);
             break;
-        case Protocol::COM_CREATE_ART:
-            result2 = db.createArticle(command.parameters[0].getInt(), command.parameters[1].getString(), command.parameters[2].getString(), command.parameters[3].getString());
-            writeCommand(conn, Protocol::ANS_CREATE_ART);
-            if (result2 == 1) {
-                writeCommand(conn, Protocol::ANS_ACK);
+        }
+        case Protocol::COM_CREATE_ART: {
+            auto [groupId, title, author, text] = codec::decodeRequest<schema::CreateArticle>(command);
+            codec::encodeAnswer<schema::CreateArticle>(reply, db.createArticle(groupId, title, author, text));
+            break;
+        }
+        case Protocol::COM_DELETE_ART: {
+            auto [groupId, articleId] = codec::decodeRequest<schema::DeleteArticle>(command);
+            auto status = db.deleteArticle(groupId, articleId);
+            if (status == Database::ArticleStatus::Found) {
+                codec::encodeAnswer<schema::DeleteArticle>(reply, true);
             } else {
-                writeCommand(conn, Protocol::ANS_NAK);
-                writeCommand(conn, Protocol::ERR_NG_DOES_NOT_EXIST); 
+                codec::encodeAnswer<schema::DeleteArticle>(reply, codec::Nak{article_error(status)});
             }
-            writeCommand(conn, Protocol::ANS_END);
             break;
-        case Protocol::COM_DELETE_ART:
-            result3 = db.deleteArticle(command.parameters[0].getInt(), command.parameters[1].getInt());
-            writeCommand(conn, Protocol::ANS_DELETE_ART);
-            if (result3 == 1) {
-                writeCommand(conn, Protocol::ANS_ACK);
-            } else {
-                writeCommand(conn, Protocol::ANS_NAK);
-                writeCommand(conn, Protocol::ERR_ART_DOES_NOT_EXIST); 
+        }
+        case Protocol::COM_GET_ART: {
+            auto [groupId, articleId] = codec::decodeRequest<schema::GetArticle>(command);
+            fetch_article(conn, groupId, articleId, open_files, [&](auto &&article) {
+                codec::encodeAnswer<schema::GetArticle>(reply, std::forward<decltype(article)>(article));
+            });
+            break;
+        }
+        case Protocol::COM_GET_ART_IF: {
+            /* The version is read before the article, so a version sent
+               with an article is never newer than the article itself */
+            require_feature(conn, feature::conditional);
+            auto [groupId, articleId, known] = codec::decodeRequest<schema::GetArticleIf>(command);
+            using Status = codec::FetchStatus;
+            using Row = std::tuple<int, std::string_view, std::string_view, std::string_view>;
+            auto [status, version] = db.getArticleVersion(groupId, articleId);
+            if (status != Database::ArticleStatus::Found) {
+                codec::encodeAnswer<schema::GetArticleIf>(reply, codec::Nak{article_error(status)});
+                break;
             }
-            writeCommand(conn, Protocol::ANS_END);
+            if (version == known) {
+                codec::encodeAnswer<schema::GetArticleIf>(reply, codec::Fetched<Row>{Status::NotModified, {}});
+                break;
+            }
+            fetch_article(conn, groupId, articleId, open_files, [&, version = version](auto &&article) {
+                if constexpr (std::is_same_v<std::remove_cvref_t<decltype(article)>, codec::Nak>) {
+                    codec::encodeAnswer<schema::GetArticleIf>(reply, article);
+                } else {
+                    std::apply(
+                        [&](auto &...fields) {
+                            auto row = std::forward_as_tuple(version, std::move(fields)...);
+                            codec::encodeAnswer<schema::GetArticleIf>(
+                                reply, codec::Fetched<decltype(row)>{Status::Found, std::move(row)});
+                        },
+                        *article);
+                }
+            });
             break;
-        case Protocol::COM_GET_ART:
-            result6 = db.getArticle(command.parameters[0].getInt(), command.parameters[1].getInt());
-            writeCommand(conn, Protocol::ANS_GET_ART);
-
-            if (std::get<0>(result6)) {  
-                writeCommand(conn, Protocol::ANS_ACK);
-                writeParString(conn, std::get<1>(result6)); 
-                writeParString(conn, std::get<2>(result6));  
-                writeParString(conn, std::get<3>(result6));
-            } else {
-                writeCommand(conn, Protocol::ANS_NAK);
-                writeCommand(conn, Protocol::ERR_NG_DOES_NOT_EXIST);
+        }
+        case Protocol::COM_HELLO: {
+            auto [version, offered] = codec::decodeRequest<schema::Hello>(command);
+            int agreed = offered & server_features;
+            conn.setFeatures(agreed);
+            codec::encodeAnswer<schema::Hello>(reply, std::tuple(std::min(version, protocol_version), agreed));
+            break;
+        }
+        case Protocol::COM_BATCH:
+            /* The commands are decoded as part of the batch, so a batch
+               never contains another one */
+            require_feature(conn, feature::batch);
+            reply.command(Protocol::ANS_BATCH);
+            reply.number(static_cast<int>(command.batch.size()));
+            for (auto &item : command.batch) {
+                encode_answer(conn, reply, item, open_files);
             }
-            writeCommand(conn, Protocol::ANS_END);
+            reply.command(Protocol::ANS_END);
+            break;
         default:
             break;
     }
 }
 
-void serve_one(Server &server) {
-    auto conn = server.waitForActivity();
-    if (conn != nullptr) {
+/*
+ * Appends the answer to a command to reply. The returned files must stay
+ * open until the reply has been written.
+ */
+std::vector<ArticleFile> build_answer(const Connection &conn, ReplyBuilder &reply, Command &command) {
+    std::vector<ArticleFile> open_files;
+    reply.setCompression((conn.getFeatures() & feature::compression) != 0);
+    encode_answer(conn, reply, command, open_files);
+    return open_files;
+}
+
+void process_request(const Connection &conn, ReplyBuilder &reply, Command &command) {
+    auto open_files = build_answer(conn, reply, command);
+    reply.writeTo(conn);
+}
+
+/*
+ * Has the event loop resume reading from the client if it is paused and
+ * the connection has drained, or if the worker stops serving it. Called
+ * with the connection's mutex held.
+ */
+void resume_reading(Server &server, const std::shared_ptr<ClientConnection> &conn, bool stopping) {
+    if (conn->reading_paused && (stopping || conn->drained())) {
+        conn->reading_paused = false;
+        server.post([&server, conn] { server.pauseReading(conn, false); });
+    }
+}
+
+/*
+ * Runs the pending commands of a connection until there are none left.
+ */
+void run_pending(Server &server, const std::shared_ptr<ClientConnection> &conn) {
+    while (true) {
+        std::optional<Command> command;
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            if (!conn->pending.empty()) {
+                command.emplace(std::move(conn->pending.front()));
+                conn->pending.pop_front();
+            }
+        }
         try {
-            process_request(conn);
+            if (command.has_value()) {
+                auto open_files = build_answer(*conn, conn->reply, *command);
+                conn->setOutput(conn->reply.size());
+                conn->reply.writeTo(*conn);
+                conn->setOutput(0);
+                std::lock_guard<std::mutex> lock(conn->mutex);
+                resume_reading(server, conn, false);
+                continue;
+            }
+            /* The answers to pipelined commands are sent together */
+            conn->flush();
+        } catch (ConnectionClosedException &) {
+            /* The event loop notices the closed socket and deregisters
+               it, once it reads from the client again */
+            conn->setOutput(0);
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            conn->pending.clear();
+            conn->running = false;
+            resume_reading(server, conn, true);
+            return;
+        } catch (std::exception &e) {
+            /* E.g. a failing database: the answer may be incomplete, so
+               the client cannot be served any further */
+            cerr << "Error while serving a client, closing connection: " << e.what() << endl;
+            conn->reply.clear();
+            conn->shutdown();
+            conn->setOutput(0);
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            conn->pending.clear();
+            conn->running = false;
+            resume_reading(server, conn, true);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        if (conn->pending.empty()) {
+            conn->running = false;
+            resume_reading(server, conn, true);
+            return;
+        }
+    }
+}
+
+/*
+ * Hands commands to the worker pool, unless a worker is already
+ * running the commands of this connection. Commands that arrived
+ * together are queued together, so their answers can be sent together.
+ * Reading from the client pauses while the connection is overloaded.
+ */
+void dispatch(Server &server, ThreadPool &workers, const std::shared_ptr<ClientConnection> &conn,
+              std::vector<Command> &commands) {
+    bool pause;
+    bool start;
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        for (auto &command : commands) {
+            conn->pending.push_back(std::move(command));
+        }
+        pause = !conn->reading_paused && conn->overloaded();
+        if (pause) {
+            conn->reading_paused = true;
+        }
+        start = !conn->running;
+        conn->running = true;
+    }
+    /* If the worker resumes reading before this pause takes effect, the
+       resumption is posted and so runs after it */
+    if (pause) {
+        server.pauseReading(conn, true);
+    }
+    if (start) {
+        workers.submit([&server, conn] { run_pending(server, conn); });
+    }
+}
+
+void serve_one(Server &server, ThreadPool &workers) {
+    for (auto &conn : server.waitForActivities()) {
+        auto client = std::static_pointer_cast<ClientConnection>(conn);
+        try {
+            /* Decode what has arrived; a partial command is kept in
+               the decoder until the rest of it arrives */
+            auto input = conn->readAvailable();
+            std::vector<Command> commands;
+            client->decoder.feed(input, commands);
+            conn->consume(input.size());
+            if (!commands.empty()) {
+                dispatch(server, workers, client, commands);
+            }
         } catch (ConnectionClosedException &) {
             server.deregisterConnection(conn);
             cout << "Client closed connection" << endl;
+        } catch (std::runtime_error &e) {
+            server.deregisterConnection(conn);
+            cout << "Protocol error, closing connection: " << e.what() << endl;
+        }
+    }
+}
+
+/*
+ * Serves a client without a worker pool: the commands are run by the
+ * event loop thread, which switches to another client whenever this
+ * one has to wait.
+ */
+Task handle_client(AsyncConnection &conn) {
+    ReplyBuilder reply;
+    while (true) {
+        Command command = co_await conn.readCommand();
+        process_request(conn, reply, command);
+        co_await conn.send();
+    }
+}
+
+void serve_async(Server &server) {
+    for (auto &conn : server.waitForActivities()) {
+        try {
+            if (!std::static_pointer_cast<AsyncConnection>(conn)->onActivity(server)) {
+                server.deregisterConnection(conn);
+                cout << "Client closed connection" << endl;
+            }
+        } catch (ConnectionClosedException &) {
+            server.deregisterConnection(conn);
+            cout << "Client closed connection" << endl;
+        } catch (std::runtime_error &e) {
+            server.deregisterConnection(conn);
+            cout << "Protocol error, closing connection: " << e.what() << endl;
+        } catch (std::exception &e) {
+            /* Ended the coroutine of the client, e.g. std::bad_alloc */
+            server.deregisterConnection(conn);
+            cerr << "Error while serving a client, closing connection: " << e.what() << endl;
+        }
+    }
+}
+
+/*
+ * Runs the event loop of a server. With several loops, each one runs on
+ * its own core. Without workers, requests are run as coroutines.
+ */
+void event_loop(Server &server, ThreadPool *workers, int loop, int loops) {
+    if (loops > 1) {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(loop % cores, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    while (true) {
+        if (workers != nullptr) {
+            serve_one(server, *workers);
+        } else {
+            serve_async(server);
         }
-    } else {
-        conn = std::make_shared<Connection>();
-        server.registerConnection(conn);
-        cout << "New client connects" << endl;
     }
 }
 
 int main(int argc, char *argv[]) {
-        auto server = init(argc, argv);
-        cout << "Waiting for activity" << endl;
-        while (true) {
-                serve_one(server);
+        auto options = parse_options(argc, argv);
+
+        /* One listening socket per event loop, all bound to the same port */
+        std::vector<std::unique_ptr<Server>> servers;
+        for (int i = 0; i < options.loops; ++i) {
+                servers.push_back(init(options));
+        }
+        std::optional<ThreadPool> workers;
+        if (options.coroutines) {
+                AsyncConnection::setOutputLimits(16 * 1024, 256 * 1024, options.output_limit << 20);
+                cout << "Waiting for activity, " << servers.size()
+                     << " event loops running coroutines" << endl;
+        } else {
+                workers.emplace(options.workers);
+                ClientConnection::total_limit = options.output_limit << 20;
+                cout << "Waiting for activity, " << servers.size() << " event loops, "
+                     << workers->size() << " worker threads" << endl;
+        }
+        ThreadPool *pool = workers ? &*workers : nullptr;
+
+        std::vector<std::thread> loops;
+        for (int i = 1; i < options.loops; ++i) {
+                loops.emplace_back(event_loop, std::ref(*servers[i]), pool, i, options.loops);
         }
+        event_loop(*servers[0], pool, 0, options.loops);
         return 0;
 }
@@ -0,0 +1,275 @@
+/* newsbench.cc: load generator for the news server.
+ *
+ * Measures two rates against a running server:
+ *  - connections/s: each client thread repeatedly connects, lists the
+ *    newsgroups and disconnects
+ *  - requests/s: each client thread keeps a number of connections open
+ *    and sends COM_LIST_NG on all of them before reading the answers
+ *  - articles/s (with -a): each client thread creates articles in the
+ *    newsgroup "newsbench" through a NewsClient, 100 requests at a time
+ *  - batched articles/s (with -a): the same, but the 100 requests are
+ *    sent as one COM_BATCH
+ */
+#include "connection.h"
+#include "connectionclosedexception.h"
+#include "newsclient.h"
+#include "protocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h> /* getopt() */
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+
+struct Options {
+    string host;
+    int port = -1;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int connections = 8;
+    int seconds = 5;
+    bool articles = false;
+};
+
+void usage() {
+    cerr << "Usage: newsbench [-t client-threads] [-c connections-per-thread] "
+            "[-d seconds] [-a] host-name port-number" << endl;
+    exit(1);
+}
+
+int positive_number(const char *arg) {
+    try {
+        int value = std::stoi(arg);
+        if (value > 0) {
+            return value;
+        }
+    } catch (std::exception &) {
+    }
+    usage();
+    return 0;
+}
+
+Options parse_options(int argc, char *argv[]) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:d:a")) != -1) {
+        switch (opt) {
+        case 't':
+            options.threads = positive_number(optarg);
+            break;
+        case 'c':
+            options.connections = positive_number(optarg);
+            break;
+        case 'd':
+            options.seconds = positive_number(optarg);
+            break;
+        case 'a':
+            options.articles = true;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 2) {
+        usage();
+    }
+    options.host = argv[optind];
+    options.port = positive_number(argv[optind + 1]);
+    return options;
+}
+
+int readNumber(const Connection &conn) {
+    unsigned char byte1 = conn.read();
+    unsigned char byte2 = conn.read();
+    unsigned char byte3 = conn.read();
+    unsigned char byte4 = conn.read();
+    return (byte1 << 24) | (byte2 << 16) | (byte3 << 8) | byte4;
+}
+
+void expect(const Connection &conn, Protocol expected) {
+    if (conn.read() != static_cast<unsigned char>(expected)) {
+        throw std::runtime_error("unexpected answer");
+    }
+}
+
+void sendListNewsgroups(const Connection &conn) {
+    conn.write(static_cast<unsigned char>(Protocol::COM_LIST_NG));
+    conn.write(static_cast<unsigned char>(Protocol::COM_END));
+}
+
+void readListNewsgroups(const Connection &conn) {
+    expect(conn, Protocol::ANS_LIST_NG);
+    expect(conn, Protocol::PAR_NUM);
+    int count = readNumber(conn);
+    string name;
+    for (int i = 0; i < count; ++i) {
+        expect(conn, Protocol::PAR_NUM);
+        readNumber(conn);
+        expect(conn, Protocol::PAR_STRING);
+        conn.readExact(name, readNumber(conn));
+    }
+    expect(conn, Protocol::ANS_END);
+}
+
+/*
+ * Runs 'body' on options.threads threads until the time is up and
+ * returns the total number of operations per second. An exception
+ * thrown by a thread is rethrown here.
+ */
+template <typename Body>
+double run(const Options &options, Body body) {
+    std::atomic<bool> done{false};
+    std::atomic<long> total{0};
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.threads; ++i) {
+        threads.emplace_back([&] {
+            try {
+                total += body(done);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failure_mutex);
+                failure = std::current_exception();
+                done = true;
+            }
+        });
+    }
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(options.seconds);
+    while (!done && std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    done = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    return static_cast<double>(total) / options.seconds;
+}
+
+int main(int argc, char *argv[]) {
+    Options options = parse_options(argc, argv);
+
+    try {
+        double connects = run(options, [&](const std::atomic<bool> &done) {
+            long count = 0;
+            while (!done) {
+                Connection conn(options.host.c_str(), options.port);
+                if (!conn.isConnected()) {
+                    throw std::runtime_error("connection attempt failed");
+                }
+                sendListNewsgroups(conn);
+                conn.flush();
+                readListNewsgroups(conn);
+                ++count;
+            }
+            return count;
+        });
+
+        double requests = run(options, [&](const std::atomic<bool> &done) {
+            std::vector<std::unique_ptr<Connection>> conns;
+            for (int i = 0; i < options.connections; ++i) {
+                conns.push_back(std::make_unique<Connection>(options.host.c_str(), options.port));
+                if (!conns.back()->isConnected()) {
+                    throw std::runtime_error("connection attempt failed");
+                }
+            }
+            long count = 0;
+            while (!done) {
+                for (auto &conn : conns) {
+                    sendListNewsgroups(*conn);
+                    conn->flush();
+                }
+                for (auto &conn : conns) {
+                    readListNewsgroups(*conn);
+                }
+                count += conns.size();
+            }
+            return count;
+        });
+
+        cout << "connections/s: " << static_cast<long>(connects) << endl;
+        cout << "requests/s: " << static_cast<long>(requests) << endl;
+
+        if (options.articles) {
+            auto create = [&](bool batched) {
+                return run(options, [&](const std::atomic<bool> &done) {
+                    NewsClient client(options.host.c_str(), options.port);
+                    if (!client.isConnected()) {
+                        throw std::runtime_error("connection attempt failed");
+                    }
+                    if (batched) {
+                        auto agreed = client.hello(feature::batch);
+                        client.flush();
+                        if ((agreed.get() & feature::batch) == 0) {
+                            throw std::runtime_error("the server does not support batches");
+                        }
+                    }
+                    client.createNewsgroup("newsbench");
+                    auto groups = client.listNewsgroups();
+                    client.flush();
+                    int group = -1;
+                    for (auto &g : groups.get()) {
+                        if (g.second == "newsbench") {
+                            group = g.first;
+                        }
+                    }
+                    long count = 0;
+                    std::vector<std::future<bool>> created;
+                    std::vector<NewsClient::NewArticle> batch;
+                    while (!done) {
+                        for (int i = 0; i < 100; ++i) {
+                            string title = "title " + std::to_string(count + i);
+                            if (batched) {
+                                batch.emplace_back(title, "newsbench", "text");
+                            } else {
+                                created.push_back(client.createArticle(group, title, "newsbench", "text"));
+                            }
+                        }
+                        std::vector<bool> results;
+                        if (batched) {
+                            auto answer = client.createArticles(group, batch);
+                            client.flush();
+                            results = answer.get();
+                            batch.clear();
+                        } else {
+                            client.flush();
+                            for (auto &f : created) {
+                                results.push_back(f.get());
+                            }
+                            created.clear();
+                        }
+                        if (std::find(results.begin(), results.end(), false) != results.end()) {
+                            throw std::runtime_error("article not created");
+                        }
+                        count += 100;
+                    }
+                    return count;
+                });
+            };
+            cout << "articles/s: " << static_cast<long>(create(false)) << endl;
+            cout << "batched articles/s: " << static_cast<long>(create(true)) << endl;
+        }
+    } catch (ConnectionClosedException &) {
+        cerr << "Server closed the connection" << endl;
+        return 1;
+    } catch (std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef ARTICLE_TABLE_H
+#define ARTICLE_TABLE_H
+
+#include "StringArena.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/*
+ * The articles of a newsgroup, in id order. Article ids only grow, so
+ * new articles are appended to flat vectors and found by binary search.
+ * Deleted articles are left as tombstones until they make up half of the
+ * table. The ids and titles are kept apart
+ * from the authors and texts, so that listing only reads the former.
+ *
+ * The strings are stored in an arena that belongs to the table, with
+ * each author stored once, so they are all freed together with the
+ * newsgroup. The arena is rebuilt when the tombstones are removed.
+ */
+class ArticleTable {
+public:
+    /* Adds an article; the id must be greater than those of all others */
+    void append(int id, std::string_view title, std::string_view author, std::string_view text, int version);
+
+    /* Deletes an article; false if there is no article with the id */
+    bool erase(int id);
+
+    /* The position of the article with the id, nullopt if there is none.
+       Positions are valid until the next append() or erase() */
+    std::optional<std::size_t> find(int id) const;
+
+    /* The strings are valid until the next erase() */
+    std::string_view title(std::size_t pos) const { return titles[pos]; }
+    std::string_view author(std::size_t pos) const { return bodies[pos].author; }
+    std::string_view text(std::size_t pos) const { return bodies[pos].text; }
+    int version(std::size_t pos) const { return bodies[pos].version; }
+
+    /* The number of articles */
+    std::size_t size() const { return ids.size() - deletedCount; }
+
+    /* The ids and titles of at most limit articles with ids greater than
+       afterId, or from the first article, in id order */
+    std::vector<std::pair<int, std::string>> list(std::optional<int> afterId, std::size_t limit) const;
+
+private:
+    struct Body {
+        int version;
+        std::string_view author, text;
+    };
+
+    std::vector<int> ids; // sorted
+    std::vector<bool> deleted;
+    std::vector<std::string_view> titles;
+    std::vector<Body> bodies;
+    std::size_t deletedCount = 0;
+
+    StringArena strings;
+    std::unordered_set<std::string_view> authors;
+
+    /* The author stored in strings, once */
+    std::string_view intern(std::string_view author);
+
+    /* Removes the tombstones */
+    void compact();
+};
+
+#endif
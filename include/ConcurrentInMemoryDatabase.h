@@ -0,0 +1,95 @@
+#ifndef CONCURRENT_IN_MEMORY_DATABASE_H
+#define CONCURRENT_IN_MEMORY_DATABASE_H
+
+#include "Database.h"
+#include "ArticleTable.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+/*
+ * An in-memory database that may be used from several threads without
+ * SynchronizedDatabase. The newsgroups are spread over shards by id, each
+ * with its own lock, so requests for newsgroups in different shards never
+ * wait for each other. Listing and fetching take a shared lock on one
+ * shard, creating and deleting articles an exclusive one. Ids come from
+ * atomic counters.
+ *
+ * The lists of newsgroups and of the articles of each newsgroup are kept
+ * as immutable listings, built when they are first asked for after a
+ * change and then shared by all readers until the next change.
+ */
+class ConcurrentInMemoryDatabase : public Database {
+public:
+    static constexpr std::size_t shard_count = 16;
+
+    ConcurrentInMemoryDatabase() = default;
+    virtual ~ConcurrentInMemoryDatabase();
+    bool createNewsgroup(std::string_view name) override;
+    bool deleteNewsgroup(int id) override;
+    std::vector<std::pair<int, std::string>> listNewsgroups() const override;
+
+    bool createArticle(int newsgroupId, std::string_view title, std::string_view author, std::string_view text) override;
+    ArticleStatus deleteArticle(int newsgroupId, int articleId) override;
+    std::tuple<ArticleStatus, std::string, std::string, std::string> getArticle(int newsgroupId, int articleId) const override;
+    std::pair<ArticleStatus, int> getArticleVersion(int newsgroupId, int articleId) const override;
+    std::optional<std::vector<std::pair<int, std::string>>> listArticles(int newsgroupId) const override;
+    std::optional<std::vector<std::pair<int, std::string>>> listArticles(int newsgroupId, std::optional<int> afterId, std::size_t limit) const override;
+    Listing newsgroupListing() const override;
+    Listing articleListing(int newsgroupId) const override;
+
+private:
+    /* Newsgroups are constructed in place, since the listing cannot be
+       moved. The listing is reset when the articles change, which needs
+       the exclusive lock, so readers that find it empty under the shared
+       lock may all build and store it */
+    struct Newsgroup {
+        int id;
+        std::string name;
+        ArticleTable articles;
+        mutable std::atomic<Listing> listing;
+    };
+
+    /* The newsgroup listing and the number of changes it includes */
+    struct NewsgroupSnapshot {
+        std::uint64_t generation;
+        std::vector<std::pair<int, std::string>> newsgroups;
+    };
+
+    /* Aligned to a cache line so that the locks of neighbouring shards
+       are not written by the same cache line */
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<int, Newsgroup> newsgroups;
+    };
+
+    /* The names in use, sharded by their hash, so that a name is only
+       checked against the names of its own shard */
+    struct alignas(64) NameShard {
+        std::mutex mutex;
+        std::unordered_set<std::string> names;
+    };
+
+    std::atomic<int> nextNewsgroupId{0}, nextArticleId{0};
+
+    /* Counts the creations and deletions of newsgroups. Each one is made
+       before it is counted, so a listing built after reading the count
+       includes at least the counted changes */
+    std::atomic<std::uint64_t> newsgroupGeneration{0};
+    mutable std::atomic<std::shared_ptr<const NewsgroupSnapshot>> newsgroupSnapshot;
+    std::array<Shard, shard_count> shards;
+    std::array<NameShard, shard_count> names;
+
+    Shard& shardOf(int newsgroupId);
+    const Shard& shardOf(int newsgroupId) const;
+    NameShard& nameShardOf(std::string_view name);
+};
+
+#endif
@@ -4,12 +4,26 @@
 #include "Database.h"
 #include <filesystem>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <optional>
 
+/*
+ * Stores each newsgroup as a directory and each article as a file in it.
+ * A newsgroup gets the hash of its name as id, or the next free id if
+ * that is taken by another name; the ids of the names are indexed in
+ * memory, read from the directories at startup.
+ */
 class DiskDatabase : public Database {
 private:
     std::filesystem::path dbRoot;
+    std::unordered_map<std::string, int> newsgroupIds; // by name
+
+    static std::optional<std::string> readName(const std::filesystem::path& newsgroupPath);
+
+    // Whether the newsgroup or only the article is missing, for an
+    // article that has no file
+    ArticleStatus missing(int newsgroupId) const;
 
     struct Article {
         int id;
@@ -26,14 +40,17 @@ private:
 public:
     DiskDatabase(const std::string& rootPath);
     virtual ~DiskDatabase();
-    bool createNewsgroup(const std::string& name) override;
+    bool createNewsgroup(std::string_view name) override;
     bool deleteNewsgroup(int id) override;
     std::vector<std::pair<int, std::string>> listNewsgroups() const override;
 
-    bool createArticle(int newsgroupId, const std::string& title, const std::string& author, const std::string& text) override;
-    bool deleteArticle(int newsgroupId, int articleId) override;
-    std::tuple<bool, std::string, std::string, std::string> getArticle(int newsgroupId, int articleId) const override;
+    bool createArticle(int newsgroupId, std::string_view title, std::string_view author, std::string_view text) override;
+    ArticleStatus deleteArticle(int newsgroupId, int articleId) override;
+    std::tuple<ArticleStatus, std::string, std::string, std::string> getArticle(int newsgroupId, int articleId) const override;
+    std::pair<ArticleStatus, int> getArticleVersion(int newsgroupId, int articleId) const override;
     std::optional<std::vector<std::pair<int, std::string>>> listArticles(int newsgroupId) const override;
+    std::optional<std::vector<std::pair<int, std::string>>> listArticles(int newsgroupId, std::optional<int> afterId, std::size_t limit) const override;
+    std::optional<ArticleFile> getArticleFile(int newsgroupId, int articleId) const override;
 };
 
 #endif
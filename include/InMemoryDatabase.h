@@ -1,33 +1,32 @@
 #include "Database.h"
+#include "ArticleTable.h"
 #include <unordered_map>
 #include <memory>
 #include <optional>
 
 class InMemoryDatabase : public Database {
 private:
-    struct Article {
-        int id;
-        std::string title, author, text;
-    };
-
     struct Newsgroup {
         int id;
         std::string name;
-        std::unordered_map<int, Article> articles;
+        ArticleTable articles;
     };
 
     int nextNewsgroupId = 0, nextArticleId = 0;
     std::unordered_map<int, Newsgroup> newsgroups;
+    std::unordered_map<std::string, int> newsgroupIds; // by name
 
 public:
     InMemoryDatabase() = default;
     virtual ~InMemoryDatabase();
-    bool createNewsgroup(const std::string& name) override;
+    bool createNewsgroup(std::string_view name) override;
     bool deleteNewsgroup(int id) override;
     std::vector<std::pair<int, std::string>> listNewsgroups() const override;
 
-    bool createArticle(int newsgroupId, const std::string& title, const std::string& author, const std::string& text) override;
-    bool deleteArticle(int newsgroupId, int articleId) override;
-    std::tuple<bool, std::string, std::string, std::string> getArticle(int newsgroupId, int articleId) const override;
+    bool createArticle(int newsgroupId, std::string_view title, std::string_view author, std::string_view text) override;
+    ArticleStatus deleteArticle(int newsgroupId, int articleId) override;
+    std::tuple<ArticleStatus, std::string, std::string, std::string> getArticle(int newsgroupId, int articleId) const override;
+    std::pair<ArticleStatus, int> getArticleVersion(int newsgroupId, int articleId) const override;
     std::optional<std::vector<std::pair<int, std::string>>> listArticles(int newsgroupId) const override;
+    std::optional<std::vector<std::pair<int, std::string>>> listArticles(int newsgroupId, std::optional<int> afterId, std::size_t limit) const override;
 };
@@ -0,0 +1,48 @@
+#ifndef STRING_ARENA_H
+#define STRING_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * Storage for strings that are all freed together, when the arena is
+ * destroyed. Strings are copied into blocks that grow from min_block to
+ * max_block bytes, so storing one is usually a pointer bump instead of a
+ * call to the allocator. Strings longer than a quarter of max_block get
+ * a block of their own.
+ */
+class StringArena {
+public:
+    static constexpr std::size_t min_block = 256;
+    static constexpr std::size_t max_block = 64 * 1024;
+
+    StringArena() = default;
+    StringArena(StringArena&& o) noexcept
+        : blocks(std::move(o.blocks)), next(std::exchange(o.next, nullptr)),
+          left(std::exchange(o.left, 0)), blockSize(std::exchange(o.blockSize, 0)) {}
+    StringArena& operator=(StringArena&& o) noexcept {
+        std::swap(blocks, o.blocks);
+        std::swap(next, o.next);
+        std::swap(left, o.left);
+        std::swap(blockSize, o.blockSize);
+        return *this;
+    }
+
+    /* The views would refer to the other arena */
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    /* Copies s into the arena. The view is valid as long as the arena */
+    std::string_view store(std::string_view s);
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* next = nullptr;
+    std::size_t left = 0;
+    std::size_t blockSize = 0; // of the block next points into
+};
+
+#endif
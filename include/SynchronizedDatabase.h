@@ -0,0 +1,35 @@
+#ifndef SYNCHRONIZED_DATABASE_H
+#define SYNCHRONIZED_DATABASE_H
+
+#include "Database.h"
+#include <shared_mutex>
+
+/*
+ * Makes any Database safe to use from several threads. Listing and
+ * fetching take a shared lock, so they run in parallel; creating and
+ * deleting take an exclusive lock.
+ */
+class SynchronizedDatabase : public Database {
+private:
+    Database& db;
+    mutable std::shared_mutex mutex;
+
+public:
+    explicit SynchronizedDatabase(Database& backend);
+    virtual ~SynchronizedDatabase();
+    bool createNewsgroup(std::string_view name) override;
+    bool deleteNewsgroup(int id) override;
+    std::vector<std::pair<int, std::string>> listNewsgroups() const override;
+
+    bool createArticle(int newsgroupId, std::string_view title, std::string_view author, std::string_view text) override;
+    ArticleStatus deleteArticle(int newsgroupId, int articleId) override;
+    std::tuple<ArticleStatus, std::string, std::string, std::string> getArticle(int newsgroupId, int articleId) const override;
+    std::pair<ArticleStatus, int> getArticleVersion(int newsgroupId, int articleId) const override;
+    std::optional<std::vector<std::pair<int, std::string>>> listArticles(int newsgroupId) const override;
+    std::optional<std::vector<std::pair<int, std::string>>> listArticles(int newsgroupId, std::optional<int> afterId, std::size_t limit) const override;
+    Listing newsgroupListing() const override;
+    Listing articleListing(int newsgroupId) const override;
+    std::optional<ArticleFile> getArticleFile(int newsgroupId, int articleId) const override;
+};
+
+#endif
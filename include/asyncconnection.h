@@ -0,0 +1,158 @@
+// ------------------------------------------------------------------
+//
+//                                 Client/Server communication package
+//
+//                                        AsyncConnection header file
+//
+// An AsyncConnection is served by a coroutine that is written as if
+// it had the connection to itself:
+//
+//     Task handle(AsyncConnection &conn) {
+//         while (true) {
+//             Command command = co_await conn.readCommand();
+//             ... write the answer ...
+//             co_await conn.send();
+//         }
+//     }
+//
+// Instead of blocking, the coroutine is suspended until the server
+// reports activity on the connection, so one event loop thread can
+// serve thousands of connections.
+//
+// ------------------------------------------------------------------
+
+#ifndef ASYNC_CONNECTION_H
+#define ASYNC_CONNECTION_H
+
+#include "command.h"
+#include "commanddecoder.h"
+#include "connection.h"
+#include "task.h"
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+class Server;
+
+class AsyncConnection : public Connection,
+                        public std::enable_shared_from_this<AsyncConnection> {
+public:
+    using Handler = std::function<Task(AsyncConnection &)>;
+
+    /* Creates a connection that will be served by 'handler'. The
+       handler is started when the client first shows activity */
+    explicit AsyncConnection(Handler handler);
+
+    /* Removes the connection's output from the total, see
+       setOutputLimits() */
+    ~AsyncConnection() override;
+
+    /* Limits the output that waits to be sent. Reading from a
+       connection pauses while more than 'high' bytes wait on it, and
+       co_await send() waits until at most 'low' bytes are left. While
+       all connections together hold more than 'total' bytes, they
+       wait until their output has been sent completely. Must be
+       called before connections are created */
+    static void setOutputLimits(std::size_t low, std::size_t high, std::size_t total);
+
+    /* co_await readCommand() returns the next command from the client.
+       Throws ConnectionClosedException if the client has gone */
+    class CommandAwaiter {
+    public:
+        explicit CommandAwaiter(AsyncConnection &c) : conn{c} {}
+        bool await_ready() const;
+        void await_suspend(std::coroutine_handle<> h);
+        Command await_resume();
+
+    private:
+        AsyncConnection &conn;
+    };
+    CommandAwaiter readCommand();
+
+    /* co_await send() completes when the written characters have been
+       sent, apart from at most the low water mark (see
+       setOutputLimits()); the rest is sent in the background. If more
+       commands have arrived, small answers are kept until those have
+       been answered too. Writes to an AsyncConnection are only
+       buffered, so the connection never blocks. Throws
+       ConnectionClosedException if the client has gone */
+    class SendAwaiter {
+    public:
+        explicit SendAwaiter(AsyncConnection &c) : conn{c} {}
+        bool await_ready() const;
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() const;
+
+    private:
+        AsyncConnection &conn;
+    };
+    SendAwaiter send();
+
+    /* Writes the characters in reply and sends them, see send() */
+    SendAwaiter send(const std::string &reply);
+
+    /* Called by the event loop when the server returns this
+       connection: reads and decodes the input that has arrived and
+       resumes the handler as far as it can go. Returns false when the
+       handler has finished or the client has gone, and the connection
+       should be deregistered.
+       Rethrows the exception that ended the handler, and throws
+       std::runtime_error on input that does not follow the protocol */
+    bool onActivity(Server &server);
+
+private:
+    enum class Wait { Nothing, Command, Send };
+
+    Handler handler;
+    CommandDecoder decoder;
+
+    /* Commands decoded but not yet returned by readCommand() */
+    std::deque<Command> commands;
+
+    /* The suspended handler and what it waits for */
+    std::coroutine_handle<> waiting;
+    Wait wait{Wait::Nothing};
+
+    /* Set when the client has closed the connection */
+    bool closed{false};
+
+    /* True while the server reports when the socket is writable, and
+       while reading is paused */
+    bool watching_writable{false};
+    bool reading_paused{false};
+
+    /* Output limits, see setOutputLimits() */
+    static std::size_t low_water;
+    static std::size_t high_water;
+    static std::size_t total_limit;
+
+    /* Reading also pauses while this many commands wait */
+    static constexpr std::size_t command_limit{64};
+
+    /* Output waiting on all connections, and the part of it that is
+       this connection's */
+    static std::atomic<std::size_t> total_output;
+    std::size_t counted_output{0};
+
+    /* Returns true if the suspended handler can be resumed */
+    bool canResume();
+
+    /* Sends what the socket accepts without blocking and returns true
+       if little enough output is left for send() to complete */
+    bool drained();
+
+    /* Brings total_output up to date with this connection's output */
+    void countOutput();
+
+    /* The running handler. Declared last, so that the coroutine is
+       destroyed before the members it refers to */
+    std::optional<Task> task;
+};
+
+#endif
@@ -1,5 +1,10 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
 #include "protocol.h"
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <variant>
 
@@ -11,14 +16,16 @@ class Param {
 public:
     variant<int, string> value;
     Protocol paramType;
-    Param(Protocol paramType, const string& value) : paramType(paramType), value(value) {}
-    Param(Protocol paramType, int value) : paramType(paramType), value(value) {}
+    Param(Protocol paramType, string value) : value(std::move(value)), paramType(paramType) {}
+    Param(Protocol paramType, int value) : value(value), paramType(paramType) {}
 
-    string getString() {
+    /* The characters are not copied; the view is valid as long as the
+       Param (and so the Command holding it) exists */
+    std::string_view getString() const {
         return std::get<string>(value);
     }
 
-    int getInt() {
+    int getInt() const {
         return std::get<int>(value);
     }
 };
@@ -26,8 +33,12 @@ public:
 class Command {
 public:
     Command(Protocol commandType, vector<Param> params)
-        : commandType(commandType), parameters(params) {}
+        : commandType(commandType), parameters(std::move(params)) {}
     Protocol commandType;
     vector<Param> parameters;
+
+    /* The commands of a COM_BATCH, in the order they were sent */
+    vector<Command> batch;
 };
 
+#endif
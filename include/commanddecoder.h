@@ -0,0 +1,67 @@
+#ifndef COMMAND_DECODER_H
+#define COMMAND_DECODER_H
+
+#include "command.h"
+#include "protocol.h"
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+ * Decodes the command stream of one connection incrementally. feed()
+ * accepts whatever characters have arrived, possibly ending in the
+ * middle of a command, and resumes where it stopped on the next call.
+ *
+ * PAR_ZSTRING parameters are decompressed, so they arrive as strings.
+ *
+ * A COM_BATCH with the parameter n is followed by n ordinary commands.
+ * They are collected in its batch, and the COM_BATCH is completed with
+ * the last of them.
+ */
+class CommandDecoder {
+public:
+    /* Consumes all of data. Each command completed by it (up to and
+       including COM_END) is appended to commands. Throws
+       std::runtime_error if the input does not follow the protocol,
+       or a command is unknown or has the wrong parameters */
+    void feed(std::span<const unsigned char> data, std::vector<Command> &commands);
+
+    /* Returns true if part of a command has been received */
+    bool inProgress() const;
+
+    /* The largest number of commands in one batch */
+    static constexpr int max_batch{1 << 16};
+
+private:
+    enum class State { CommandType, ParamType, NumberParam, ZStringLength, StringLength, StringBody };
+
+    State state{State::CommandType};
+    Protocol commandType{Protocol::UNDEFINED};
+    std::vector<Param> params;
+
+    /* The batch being received, and how many of its commands are missing */
+    std::vector<Command> batch;
+    int batchRemaining{0};
+
+    /* The 4-byte number being received */
+    unsigned int number{0};
+    int numberBytes{0};
+
+    /* The string parameter being received. For a PAR_ZSTRING these are
+       the compressed characters */
+    std::string string;
+    std::size_t stringRemaining{0};
+    bool compressed{false};
+    std::size_t originalLength{0};
+
+    /* Adds the next byte to number. Returns true when all four
+       bytes have been received */
+    bool addNumberByte(unsigned char byte);
+
+    /* Handles a command whose COM_END has been received */
+    void complete(std::vector<Command> &commands);
+};
+
+#endif
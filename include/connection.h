@@ -28,11 +28,21 @@
 #ifndef CONNECTION_H
 #define CONNECTION_H
 
+#include <atomic>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <sys/types.h> /* off_t */
+#include <sys/uio.h>   /* iovec */
+#include <vector>
+
 class Server;
+class UringServer;
 
 /* A Connection object represents a connection (a socket)  */
 class Connection {
     friend class Server;
+    friend class UringServer;
 
 public:
     /* Establishes a connection to the computer 'host' via
@@ -49,12 +59,60 @@ public:
     /* Returns true if the connection has been established */
     bool isConnected() const;
 
-    /* Writes a character */
+    /* Writes a character. The character is buffered and is not
+       sent until the buffer is full or flush() is called */
     void write(unsigned char ch) const;
 
-    /* Reads a character */
+    /* Reads a character. Characters are read from the socket in
+       chunks and returned from the buffer */
     unsigned char read() const;
 
+    /* Reads exactly buf.size() bytes into buf */
+    void readExact(std::span<std::byte> buf) const;
+
+    /* Reads exactly n characters into s, replacing its contents. The
+       string grows as the characters arrive, so a length announced by
+       the peer does not allocate memory before the data is sent */
+    void readExact(std::string &s, std::size_t n) const;
+
+    /* Writes all bytes in data. Large blocks bypass the buffer */
+    void writeAll(std::span<const std::byte> data) const;
+
+    /* Writes all characters in s */
+    void writeAll(const std::string &s) const;
+
+    /* Writes the bytes of all the iovecs. If they do not fit in the
+       buffer, they are sent with one writev() together with the
+       buffered characters */
+    void writeAll(std::span<const iovec> data) const;
+
+    /* Writes 'length' bytes of the open file fd, starting at
+       'offset'. Large ranges are sent with sendfile(), without
+       copying them through the buffer */
+    void writeFile(int fd, off_t offset, std::size_t length) const;
+
+    /* Sends all buffered characters. Must be called at the end of
+       every message (COM_END, ANS_END) */
+    void flush() const;
+
+    /* Sends as much buffered output as the socket accepts without
+       blocking. Returns true if everything has been sent */
+    bool tryFlush() const;
+
+    /* Returns the characters that can be read without blocking: the
+       buffered ones or, if there are none, what one read from the
+       socket returns. The span is empty if nothing has arrived. The
+       characters stay in the buffer until they are consumed */
+    std::span<const unsigned char> readAvailable() const;
+
+    /* Removes the first n characters returned by readAvailable() */
+    void consume(std::size_t n) const;
+
+    /* The protocol features (see protocol.h) agreed on with the peer in
+       a COM_HELLO handshake. None until then */
+    int getFeatures() const;
+    void setFeatures(int agreed) const;
+
     /* Connection cannot be copied or assigned */
     Connection(const Connection &) = delete;
     Connection &operator=(const Connection &) = delete;
@@ -69,9 +127,34 @@ protected:
     /* The socket number that this connections communicates on */
     int my_socket{no_socket};
 
+    /* Size of the read and write buffers */
+    static constexpr std::size_t buffer_size{8192};
+
+    /* Characters received but not yet returned by read() are
+       read_buffer[read_pos] .. read_buffer[read_end - 1] */
+    mutable std::vector<unsigned char> read_buffer;
+    mutable std::size_t read_pos{0};
+    mutable std::size_t read_end{0};
+
+    /* Characters written but not yet sent */
+    mutable std::vector<unsigned char> write_buffer;
+
+    /* If false, write() and writeAll() only buffer, also when the
+       buffer is full, so nothing is sent until flush() or tryFlush() */
+    bool implicit_flush{true};
+
+    /* The features agreed on with the peer. Atomic, since a client may
+       read the answer to COM_HELLO in another thread */
+    mutable std::atomic<int> features{0};
+
+    /* Set while a server reads into read_buffer on behalf of the
+       connection. readAvailable() then only returns buffered input */
+    bool receiving{false};
+
     /* Set to true when the constructor has called signal()
-       to ignore broken pipe. See comment in the constructor */
-    static bool ignoresPipeSignals;
+       to ignore broken pipe. See comment in the constructor.
+       Atomic, since connections are created by several threads */
+    static std::atomic<bool> ignoresPipeSignals;
 
     /* Initialization from server, receives socket number s */
     void initConnection(int s);
@@ -79,8 +162,28 @@ protected:
     /* Server fetches the socket number */
     int getSocket() const;
 
+    /* Returns true if read() can return a character without
+       reading from the socket */
+    bool hasBufferedInput() const;
+
     /* Prints error message and exits */
     void error(const char *msg) const;
+
+private:
+    /* Reads at least one character from the socket into the
+       (empty) read buffer */
+    void fillBuffer() const;
+
+    /* Sends len bytes from data directly to the socket */
+    void sendAll(const unsigned char *data, std::size_t len) const;
+
+    /* Sends the buffered characters followed by the bytes of the
+       iovecs, with as few writev() calls as possible */
+    void sendVector(std::span<const iovec> data) const;
+
+    /* Blocks until a non-blocking socket is ready for 'events'
+       (POLLIN, POLLOUT) */
+    void waitFor(short events) const;
 };
 
 #endif
@@ -1,23 +1,137 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <tuple>
 #include <optional>
+#include <utility>
+#include <sys/types.h>
+#include <unistd.h>
 
+/*
+ * The text of an article as a byte range of an open file, so that it
+ * can be sent with sendfile(). The file is closed when the object is
+ * destroyed; until then the text stays readable even if the article
+ * is deleted.
+ */
+class ArticleFile {
+public:
+    std::string title, author;
+    int fd;
+    off_t offset = 0;
+    std::size_t length = 0;
+
+    explicit ArticleFile(int file) : fd(file) {}
+    ArticleFile(ArticleFile&& o) noexcept
+        : title(std::move(o.title)), author(std::move(o.author)),
+          fd(std::exchange(o.fd, -1)), offset(o.offset), length(o.length) {}
+    ArticleFile& operator=(ArticleFile&& o) noexcept {
+        std::swap(title, o.title);
+        std::swap(author, o.author);
+        std::swap(fd, o.fd);
+        offset = o.offset;
+        length = o.length;
+        return *this;
+    }
+    ArticleFile(const ArticleFile&) = delete;
+    ArticleFile& operator=(const ArticleFile&) = delete;
+    ~ArticleFile() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+// The create functions copy their strings into storage; the views need
+// only be valid during the call.
 class Database {
 public:
+    // An immutable list of ids and names, shared by all readers
+    using Listing = std::shared_ptr<const std::vector<std::pair<int, std::string>>>;
+
+    // Whether an article was found (and, by deleteArticle(), deleted),
+    // or which of the newsgroup and the article does not exist
+    enum class ArticleStatus { Found, NoNewsgroup, NoArticle };
+
     virtual ~Database() {}
 
-    virtual bool createNewsgroup(const std::string& name) = 0;
+    virtual bool createNewsgroup(std::string_view name) = 0;
     virtual bool deleteNewsgroup(int id) = 0;
     virtual std::vector<std::pair<int, std::string>> listNewsgroups() const = 0;
 
-    virtual bool createArticle(int newsgroupId, const std::string& title, const std::string& author, const std::string& text) = 0;
-    virtual bool deleteArticle(int newsgroupId, int articleId) = 0;
-    virtual std::tuple<bool, std::string, std::string, std::string> getArticle(int newsgroupId, int articleId) const = 0;
+    virtual bool createArticle(int newsgroupId, std::string_view title, std::string_view author, std::string_view text) = 0;
+    virtual ArticleStatus deleteArticle(int newsgroupId, int articleId) = 0;
+    virtual std::tuple<ArticleStatus, std::string, std::string, std::string> getArticle(int newsgroupId, int articleId) const = 0;
     virtual std::optional<std::vector<std::pair<int, std::string>>> listArticles(int newsgroupId) const = 0;
+
+    // One page of the articles of a newsgroup: those with ids greater
+    // than afterId (all if it is nullopt), in increasing id order, at
+    // most limit of them. The next page starts after the last id of this
+    // one. Returns nullopt if the newsgroup does not exist.
+    // This version sorts the whole list; databases override it to avoid that.
+    virtual std::optional<std::vector<std::pair<int, std::string>>> listArticles(int newsgroupId, std::optional<int> afterId, std::size_t limit) const {
+        auto articles = listArticles(newsgroupId);
+        if (articles.has_value()) {
+            std::erase_if(*articles, [&](const auto& article) { return afterId.has_value() && article.first <= *afterId; });
+            std::sort(articles->begin(), articles->end());
+            if (articles->size() > limit) {
+                articles->resize(limit);
+            }
+        }
+        return articles;
+    }
+
+    // The same lists as listNewsgroups() and listArticles(), the latter
+    // nullptr if the newsgroup does not exist. Databases that keep the
+    // lists between changes hand out the same one to every reader until
+    // it changes; this version builds a new one on each call.
+    virtual Listing newsgroupListing() const {
+        return std::make_shared<const std::vector<std::pair<int, std::string>>>(listNewsgroups());
+    }
+    virtual Listing articleListing(int newsgroupId) const {
+        auto articles = listArticles(newsgroupId);
+        if (!articles.has_value()) {
+            return nullptr;
+        }
+        return std::make_shared<const std::vector<std::pair<int, std::string>>>(std::move(*articles));
+    }
+
+    // A token that changes whenever the content of an article may have
+    // changed, and is never 0. It is only valid if the status is Found.
+    // This version hashes what getArticle() returns.
+    virtual std::pair<ArticleStatus, int> getArticleVersion(int newsgroupId, int articleId) const {
+        auto [status, title, author, text] = getArticle(newsgroupId, articleId);
+        if (status != ArticleStatus::Found) {
+            return {status, 0};
+        }
+        return {status, hashVersion({title, author, text})};
+    }
+
+    // Databases that store each article in a file return its text as a
+    // file range. Others return nullopt, as for a missing article, and
+    // getArticle() must be used.
+    virtual std::optional<ArticleFile> getArticleFile(int /* newsgroupId */, int /* articleId */) const {
+        return std::nullopt;
+    }
+
+protected:
+    // A version token made from a 32-bit FNV-1a hash of the parts
+    static int hashVersion(std::initializer_list<std::string_view> parts) {
+        std::uint32_t hash = 2166136261u;
+        for (auto part : parts) {
+            for (unsigned char c : part) {
+                hash = (hash ^ c) * 16777619u;
+            }
+            hash = (hash ^ 0xFFu) * 16777619u; // so that "ab", "c" differs from "a", "bc"
+        }
+        return hash == 0 ? 1 : static_cast<int>(hash);
+    }
 };
 
 #endif
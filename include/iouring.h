@@ -0,0 +1,86 @@
+// ------------------------------------------------------------------
+//
+//                                 Client/Server communication package
+//
+//                                                IoUring header file
+//
+// An IoUring object is a minimal wrapper around a Linux io_uring
+// submission/completion queue pair, using the system calls directly.
+//
+// ------------------------------------------------------------------
+
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <linux/io_uring.h>
+
+#include <bitset>
+
+/* An io_uring instance */
+class IoUring {
+public:
+    /* Sets up a ring with room for 'entries' submissions. isReady()
+       is false if the kernel does not support io_uring */
+    explicit IoUring(unsigned entries);
+
+    /* Tears down the ring */
+    ~IoUring();
+
+    /* Returns true if the ring has been set up */
+    bool isReady() const;
+
+    /* Returns a cleared submission queue entry to be filled in, or
+       nullptr if the submission queue is full. The entry is submitted
+       by the next call to submit() */
+    io_uring_sqe *getSqe();
+
+    /* Submits the queued entries and waits until at least
+       'wait_for' completions are available. Returns false on error */
+    bool submit(unsigned wait_for);
+
+    /* Removes the oldest completion and stores it in cqe. Returns
+       false if there is none */
+    bool nextCompletion(io_uring_cqe &cqe);
+
+    /* Returns true if the kernel supports the given IORING_FEAT_ flag */
+    bool hasFeature(unsigned feature) const;
+
+    /* Returns true if the kernel supports the given IORING_OP_ opcode.
+       Kernels that cannot be probed (before 5.6) support none */
+    bool supportsOp(unsigned op) const;
+
+    /* IoUrings cannot be copied or assigned */
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+private:
+    int ring_fd{-1};
+    unsigned features{0};
+
+    /* The opcodes reported by IORING_REGISTER_PROBE */
+    std::bitset<256> supported_ops;
+
+    /* The mapped rings */
+    void *sq_ring{nullptr};
+    unsigned sq_ring_size{0};
+    void *cq_ring{nullptr};
+    unsigned cq_ring_size{0};
+    io_uring_sqe *sqes{nullptr};
+    unsigned sqes_size{0};
+
+    /* Pointers into the mapped rings */
+    unsigned *sq_head{nullptr};
+    unsigned *sq_tail{nullptr};
+    unsigned *sq_mask{nullptr};
+    unsigned *sq_entries{nullptr};
+    unsigned *sq_array{nullptr};
+    unsigned *cq_head{nullptr};
+    unsigned *cq_tail{nullptr};
+    unsigned *cq_mask{nullptr};
+    io_uring_cqe *cqes{nullptr};
+
+    /* Entries handed out by getSqe() but not yet submitted */
+    unsigned to_submit{0};
+};
+
+#endif
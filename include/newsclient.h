@@ -0,0 +1,216 @@
+#ifndef NEWS_CLIENT_H
+#define NEWS_CLIENT_H
+
+#include "connection.h"
+#include "protocol.h"
+#include "protocolcodec.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/*
+ * A client of the news server that does not wait for one answer before
+ * sending the next request. Each request returns a future for its
+ * result; the answers are read by a background thread and matched with
+ * the requests in the order they were sent.
+ *
+ * Requests are buffered and sent when the buffer is full or flush() is
+ * called, so flush() must be called before waiting for a result.
+ * A future throws ConnectionClosedException if the server goes away and
+ * std::runtime_error if the answer does not follow the protocol.
+ */
+class NewsClient {
+public:
+    using Newsgroups = codec::answer_t<schema::ListNewsgroups>;
+    using Articles = std::vector<std::pair<int, std::string>>;
+
+    /* title, author and text of an article, nullopt if it was not found */
+    using Article = codec::answer_t<schema::GetArticle>;
+
+    /* The version, title, author and text of an article, if it is not
+       the version the client already has */
+    using FetchedArticle = codec::answer_t<schema::GetArticleIf>;
+
+    /* title, author and text of an article to create */
+    using NewArticle = std::tuple<std::string, std::string, std::string>;
+
+    /* Connects to the server on 'host' at 'port' */
+    NewsClient(const char *host, int port);
+
+    /* Sends the buffered requests and waits for their answers */
+    ~NewsClient();
+
+    /* Returns true if the connection has been established */
+    bool isConnected() const;
+
+    /* Offers protocol features (feature:: in protocol.h) to the server
+       with COM_HELLO. The result is the features both sides support,
+       which features() returns from then on. Only for servers that know
+       COM_HELLO; others close the connection */
+    std::future<int> hello(int wanted);
+    int features() const;
+
+    /* The requests. The results are those of the Database functions
+       with the same names: false or nullopt if the server answers with
+       ANS_NAK */
+    std::future<Newsgroups> listNewsgroups();
+    std::future<bool> createNewsgroup(std::string_view name);
+    std::future<bool> deleteNewsgroup(int id);
+    std::future<std::optional<Articles>> listArticles(int newsgroupId);
+
+    /* One page of at most limit articles, those with ids greater than
+       afterId; see Database::listArticles(). Needs feature::pagination */
+    std::future<std::optional<Articles>> listArticles(int newsgroupId, std::optional<int> afterId, int limit);
+
+    std::future<bool> createArticle(int newsgroupId, std::string_view title, std::string_view author,
+                                    std::string_view text);
+    std::future<bool> deleteArticle(int newsgroupId, int articleId);
+    std::future<Article> getArticle(int newsgroupId, int articleId);
+
+    /* The article unless knownVersion, a version from an earlier answer,
+       is still current; 0 fetches it anyway. Needs feature::conditional */
+    std::future<FetchedArticle> getArticleIfModified(int newsgroupId, int articleId, int knownVersion);
+
+    /* Batched requests, sent as one COM_BATCH and answered together.
+       The results are in the same order as the articles. The server
+       accepts at most CommandDecoder::max_batch commands per batch.
+       Need feature::batch */
+    std::future<std::vector<bool>> createArticles(int newsgroupId, const std::vector<NewArticle> &articles);
+    std::future<std::vector<Article>> getArticles(int newsgroupId, const std::vector<int> &articleIds);
+
+    /* Sends the buffered requests */
+    void flush();
+
+    /* NewsClients cannot be copied or assigned */
+    NewsClient(const NewsClient &) = delete;
+    NewsClient &operator=(const NewsClient &) = delete;
+
+private:
+    /* A request that has been written but not answered: 'read' reads
+       the answer and sets the result, 'fail' sets an exception */
+    struct Pending {
+        std::function<void()> read;
+        std::function<void(std::exception_ptr)> fail;
+    };
+
+    /* The Writer and Reader for the codec in protocolcodec.h. length()
+       writes or reads the 4-byte length of a string */
+    struct Writer {
+        const Connection &conn;
+        void command(Protocol code);
+        void number(int value);
+        void string(std::string_view s);
+        void text(std::string_view s);
+        void length(std::size_t n);
+    };
+    struct Reader {
+        const Connection &conn;
+        Protocol code();
+        int number();
+        std::string string();
+        std::size_t length();
+    };
+
+    Connection conn;
+
+    /* Serializes the writing of requests. Held while a request is
+       sent, so the reader must not wait for it */
+    std::mutex write_mutex;
+
+    /* Protects pending, stopping and broken */
+    std::mutex mutex;
+    std::condition_variable answers_expected;
+    std::deque<Pending> pending;
+    bool stopping{false};
+
+    /* Set when the connection is lost; later requests fail at once */
+    std::exception_ptr broken;
+
+    std::thread reader;
+
+    /* Reads the answers as long as requests are pending */
+    void readAnswers();
+
+    /* Queues the answer to the request that has just been written.
+       Must be called with write_mutex locked */
+    template <typename T>
+    std::future<T> expect(std::function<T()> read);
+
+    /* Sends a command of type C and queues its answer */
+    template <typename C, typename... Args>
+    std::future<codec::answer_t<C>> request(const Args &...args);
+
+    /* Sends one command of type C for each element of items, which
+       'params' turns into the parameters, all in one batch */
+    template <typename C, typename T, typename F>
+    std::future<std::vector<codec::answer_t<C>>> batch(const std::vector<T> &items, F params);
+};
+
+template <typename T>
+std::future<T> NewsClient::expect(std::function<T()> read) {
+    auto promise = std::make_shared<std::promise<T>>();
+    auto result = promise->get_future();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (broken) {
+        promise->set_exception(broken);
+        return result;
+    }
+    pending.push_back({[promise, read] { promise->set_value(read()); },
+                       [promise](std::exception_ptr e) { promise->set_exception(e); }});
+    answers_expected.notify_one();
+    return result;
+}
+
+template <typename C, typename... Args>
+std::future<codec::answer_t<C>> NewsClient::request(const Args &...args) {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    Writer out{conn};
+    codec::encodeRequest<C>(out, args...);
+    return expect<codec::answer_t<C>>([this] {
+        Reader in{conn};
+        return codec::decodeAnswer<C>(in);
+    });
+}
+
+template <typename C, typename T, typename F>
+std::future<std::vector<codec::answer_t<C>>> NewsClient::batch(const std::vector<T> &items, F params) {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    Writer out{conn};
+    out.command(Protocol::COM_BATCH);
+    out.number(static_cast<int>(items.size()));
+    out.command(Protocol::COM_END);
+    for (auto &item : items) {
+        std::apply([&](const auto &...args) { codec::encodeRequest<C>(out, args...); }, params(item));
+    }
+    return expect<std::vector<codec::answer_t<C>>>([this, size = items.size()] {
+        Reader in{conn};
+        codec::expectCode(in, Protocol::ANS_BATCH);
+        int count = in.number();
+        if (count < 0 || static_cast<std::size_t>(count) != size) {
+            throw std::runtime_error("Batch of " + std::to_string(size) + " answered with " +
+                                     std::to_string(count) + " answers");
+        }
+        std::vector<codec::answer_t<C>> answers;
+        answers.reserve(size);
+        for (std::size_t i = 0; i != size; ++i) {
+            answers.push_back(codec::decodeAnswer<C>(in));
+        }
+        codec::expectCode(in, Protocol::ANS_END);
+        return answers;
+    });
+}
+
+#endif
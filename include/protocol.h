@@ -11,34 +11,127 @@ enum class Protocol {
     UNDEFINED = 0, // not used in protocol
 
     /* Command codes, client -> server */
-    COM_LIST_NG = 1,    // list newsgroups
-    COM_CREATE_NG = 2,  // create newsgroup
-    COM_DELETE_NG = 3,  // delete newsgroup
-    COM_LIST_ART = 4,   // list articles
-    COM_CREATE_ART = 5, // create article
-    COM_DELETE_ART = 6, // delete article
-    COM_GET_ART = 7,    // get article
-    COM_END = 8,        // command end
+    COM_LIST_NG = 1,     // list newsgroups
+    COM_CREATE_NG = 2,   // create newsgroup
+    COM_DELETE_NG = 3,   // delete newsgroup
+    COM_LIST_ART = 4,    // list articles
+    COM_CREATE_ART = 5,  // create article
+    COM_DELETE_ART = 6,  // delete article
+    COM_GET_ART = 7,     // get article
+    COM_END = 8,         // command end
+    COM_BATCH = 9,       // the next n commands, answered together
+    COM_HELLO = 10,      // protocol version and feature bits
+    COM_GET_ART_IF = 11, // get article unless the known version is current
 
     /* Answer codes, server -> client */
-    ANS_LIST_NG = 20,    // answer list newsgroups
-    ANS_CREATE_NG = 21,  // answer create newsgroup
-    ANS_DELETE_NG = 22,  // answer delete newsgroup
-    ANS_LIST_ART = 23,   // answer list articles
-    ANS_CREATE_ART = 24, // answer create article
-    ANS_DELETE_ART = 25, // answer delete article
-    ANS_GET_ART = 26,    // answer get article
-    ANS_END = 27,        // answer end
-    ANS_ACK = 28,        // acknowledge
-    ANS_NAK = 29,        // negative acknowledge
+    ANS_LIST_NG = 20,      // answer list newsgroups
+    ANS_CREATE_NG = 21,    // answer create newsgroup
+    ANS_DELETE_NG = 22,    // answer delete newsgroup
+    ANS_LIST_ART = 23,     // answer list articles
+    ANS_CREATE_ART = 24,   // answer create article
+    ANS_DELETE_ART = 25,   // answer delete article
+    ANS_GET_ART = 26,      // answer get article
+    ANS_END = 27,          // answer end
+    ANS_ACK = 28,          // acknowledge
+    ANS_NAK = 29,          // negative acknowledge
+    ANS_BATCH = 30,        // answer batch
+    ANS_HELLO = 31,        // answer hello
+    ANS_GET_ART_IF = 32,   // answer get article if modified
+    ANS_NOT_MODIFIED = 33, // the known version is current
 
     /* Parameters */
-    PAR_STRING = 40, // string
-    PAR_NUM = 41,    // number
+    PAR_STRING = 40,  // string
+    PAR_NUM = 41,     // number
+    PAR_ZSTRING = 42, // compressed string, see zstring.h
 
     /* Error codes */
     ERR_NG_ALREADY_EXISTS = 50, // newsgroup already exists
     ERR_NG_DOES_NOT_EXIST = 51, // newsgroup does not exist
     ERR_ART_DOES_NOT_EXIST = 52 // article does not exist
 };
+
+/*
+ * COM_HELLO is optional. A client that sends it, normally as its first
+ * command, offers its protocol version and the features it wants; the
+ * answer holds the version both sides speak and the offered features the
+ * server supports. Features are only used on connections that have
+ * agreed on them: the commands of a feature that has not been agreed on
+ * are rejected like unknown commands, so clients that never send
+ * COM_HELLO get the original protocol.
+ */
+constexpr int protocol_version = 1;
+
+namespace feature {
+constexpr int batch = 1 << 0;       // COM_BATCH
+constexpr int pagination = 1 << 1;  // COM_LIST_ART with a limit
+constexpr int compression = 1 << 2; // long Text items as PAR_ZSTRING
+constexpr int conditional = 1 << 3; // COM_GET_ART_IF
+} // namespace feature
+
+/*
+ * The parameters and answer of each command. protocolcodec.h generates
+ * the encoders and decoders of both sides from these types.
+ */
+namespace schema {
+
+/* Items */
+struct Num {};                                  // PAR_NUM
+struct Str {};                                  // PAR_STRING
+struct Text {};                                 // PAR_STRING, or PAR_ZSTRING with feature::compression
+template <typename Item> struct Opt {};         // a trailing parameter that may be left out
+template <typename... Items> struct List {};    // PAR_NUM n, then n rows of Items
+template <Protocol... Codes> struct Errors {}; // the error codes an ANS_NAK may carry
+template <typename Errors, typename... Items>
+struct Ack {};                                  // ANS_ACK Items, or ANS_NAK and one of the Errors
+template <typename Errors, typename... Items>
+struct IfModified {};                           // like Ack, or ANS_NOT_MODIFIED
+
+/* A command code and its parameters, and an answer code and its items */
+template <Protocol Code, typename... Params> struct Request {};
+template <Protocol Code, typename... Items> struct Answer {};
+
+template <typename RequestType, typename AnswerType>
+struct Command {
+    using request = RequestType;
+    using answer = AnswerType;
+};
+
+using ListNewsgroups = Command<Request<Protocol::COM_LIST_NG>,
+                               Answer<Protocol::ANS_LIST_NG, List<Num, Str>>>;
+using CreateNewsgroup = Command<Request<Protocol::COM_CREATE_NG, Str>,
+                                Answer<Protocol::ANS_CREATE_NG, Ack<Errors<Protocol::ERR_NG_ALREADY_EXISTS>>>>;
+using DeleteNewsgroup = Command<Request<Protocol::COM_DELETE_NG, Num>,
+                                Answer<Protocol::ANS_DELETE_NG, Ack<Errors<Protocol::ERR_NG_DOES_NOT_EXIST>>>>;
+/* newsgroup id, and for a page: limit and start-after id */
+using ListArticles = Command<Request<Protocol::COM_LIST_ART, Num, Opt<Num>, Opt<Num>>,
+                             Answer<Protocol::ANS_LIST_ART, Ack<Errors<Protocol::ERR_NG_DOES_NOT_EXIST>, List<Num, Str>>>>;
+/* newsgroup id, title, author, text */
+using CreateArticle = Command<Request<Protocol::COM_CREATE_ART, Num, Str, Str, Text>,
+                              Answer<Protocol::ANS_CREATE_ART, Ack<Errors<Protocol::ERR_NG_DOES_NOT_EXIST>>>>;
+using DeleteArticle = Command<Request<Protocol::COM_DELETE_ART, Num, Num>,
+                              Answer<Protocol::ANS_DELETE_ART,
+                                     Ack<Errors<Protocol::ERR_NG_DOES_NOT_EXIST, Protocol::ERR_ART_DOES_NOT_EXIST>>>>;
+/* title, author, text */
+using GetArticle = Command<Request<Protocol::COM_GET_ART, Num, Num>,
+                           Answer<Protocol::ANS_GET_ART,
+                                  Ack<Errors<Protocol::ERR_NG_DOES_NOT_EXIST, Protocol::ERR_ART_DOES_NOT_EXIST>,
+                                      Str, Str, Text>>>;
+
+/* newsgroup id, article id, the version the client has (0 for none);
+   version, title, author, text */
+using GetArticleIf = Command<Request<Protocol::COM_GET_ART_IF, Num, Num, Num>,
+                             Answer<Protocol::ANS_GET_ART_IF,
+                                    IfModified<Errors<Protocol::ERR_NG_DOES_NOT_EXIST, Protocol::ERR_ART_DOES_NOT_EXIST>,
+                                               Num, Str, Str, Text>>>;
+
+/* version, features */
+using Hello = Command<Request<Protocol::COM_HELLO, Num, Num>, Answer<Protocol::ANS_HELLO, Num, Num>>;
+
+/* COM_BATCH has one PAR_NUM, the number of commands that follow it */
+template <typename... Commands> struct CommandList {};
+using Commands = CommandList<ListNewsgroups, CreateNewsgroup, DeleteNewsgroup, ListArticles,
+                             CreateArticle, DeleteArticle, GetArticle, GetArticleIf, Hello>;
+
+} // namespace schema
+
 #endif
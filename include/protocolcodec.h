@@ -0,0 +1,447 @@
+#ifndef PROTOCOL_CODEC_H
+#define PROTOCOL_CODEC_H
+
+#include "command.h"
+#include "protocol.h"
+
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Encoders and decoders generated from the command schema in protocol.h.
+ * Each function is instantiated for one command, so the layout of its
+ * parameters and answer is known at compile time.
+ *
+ * A Writer has command(Protocol), number(int) and string(s) that append
+ * a code, a PAR_NUM and a PAR_STRING, and text(s) that may append a
+ * PAR_ZSTRING instead (ReplyBuilder is one). A Reader has code(),
+ * number() and string() that read them; string() accepts both kinds.
+ *
+ * Server: checkRequest() and decodeRequest() take a Command from
+ * CommandDecoder, encodeAnswer() writes the answer.
+ * Client: encodeRequest() writes a command, decodeAnswer() reads the
+ * answer. Decoders throw std::runtime_error if the input does not
+ * follow the schema.
+ */
+namespace codec {
+
+/* The value of a decoded request parameter; strings are views into
+   the Command */
+template <typename Item> struct ParamValue;
+template <> struct ParamValue<schema::Num> { using type = int; };
+template <> struct ParamValue<schema::Str> { using type = std::string_view; };
+template <> struct ParamValue<schema::Text> { using type = std::string_view; };
+template <typename Item> struct ParamValue<schema::Opt<Item>> {
+    using type = std::optional<typename ParamValue<Item>::type>;
+};
+template <typename Item> using param_t = typename ParamValue<Item>::type;
+
+/* The value of a decoded answer item */
+template <typename Item> struct Value;
+template <typename Item> using value_t = typename Value<Item>::type;
+
+/* One item is its value, several are a tuple (a pair in a list row) */
+template <typename... Items> struct Group { using type = std::tuple<value_t<Items>...>; };
+template <typename Item> struct Group<Item> { using type = value_t<Item>; };
+template <typename... Items> using group_t = typename Group<Items...>::type;
+template <typename... Items> struct Row { using type = std::tuple<value_t<Items>...>; };
+template <typename A, typename B> struct Row<A, B> { using type = std::pair<value_t<A>, value_t<B>>; };
+
+template <> struct Value<schema::Num> { using type = int; };
+template <> struct Value<schema::Str> { using type = std::string; };
+template <> struct Value<schema::Text> { using type = std::string; };
+template <typename... Items> struct Value<schema::List<Items...>> {
+    using type = std::vector<typename Row<Items...>::type>;
+};
+/* An Ack without items is true for ANS_ACK, with items it is nullopt
+   for ANS_NAK */
+template <Protocol... Codes> struct Value<schema::Ack<schema::Errors<Codes...>>> { using type = bool; };
+template <Protocol... Codes, typename... Items>
+struct Value<schema::Ack<schema::Errors<Codes...>, Items...>> {
+    using type = std::optional<group_t<Items...>>;
+};
+/* Encodes as ANS_NAK and the error code, which must be one of those of
+   the Ack or IfModified. Answers with several error codes choose one
+   this way */
+struct Nak {
+    Protocol error;
+};
+/* The result of an IfModified item */
+enum class FetchStatus { Found, NotModified, Missing };
+template <typename T> struct Fetched {
+    FetchStatus status;
+    T value; // if Found
+};
+template <Protocol... Codes, typename... Items>
+struct Value<schema::IfModified<schema::Errors<Codes...>, Items...>> {
+    using type = Fetched<group_t<Items...>>;
+};
+template <Protocol Code, typename... Items> struct Value<schema::Answer<Code, Items...>> {
+    using type = group_t<Items...>;
+};
+
+/* The result of decodeAnswer<C>() */
+template <typename C> using answer_t = value_t<typename C::answer>;
+
+/* Reads the next code and checks that it is 'expected' */
+template <typename Reader>
+void expectCode(Reader &in, Protocol expected) {
+    Protocol actual = in.code();
+    if (actual != expected) {
+        throw std::runtime_error("Expected code " + std::to_string(static_cast<int>(expected)) + ", got " +
+                                 std::to_string(static_cast<int>(actual)));
+    }
+}
+
+/* Reads the error code that follows ANS_NAK and checks that it is one
+   of Codes */
+template <Protocol... Codes, typename Reader>
+void expectError(Reader &in) {
+    Protocol error = in.code();
+    if (((error != Codes) && ...)) {
+        throw std::runtime_error("Unexpected error code " + std::to_string(static_cast<int>(error)));
+    }
+}
+
+/* ---- request parameters ---- */
+
+template <typename Item> struct ParamCodec;
+
+template <> struct ParamCodec<schema::Num> {
+    static constexpr bool optional = false;
+    static int decode(const std::vector<Param> &params, std::size_t i) {
+        const int *value = std::get_if<int>(&params[i].value);
+        if (value == nullptr) {
+            throw std::runtime_error("Expected a number parameter");
+        }
+        return *value;
+    }
+    template <typename Writer>
+    static void encode(Writer &out, int value) {
+        out.number(value);
+    }
+};
+
+template <> struct ParamCodec<schema::Str> {
+    static constexpr bool optional = false;
+    static std::string_view decode(const std::vector<Param> &params, std::size_t i) {
+        const std::string *value = std::get_if<std::string>(&params[i].value);
+        if (value == nullptr) {
+            throw std::runtime_error("Expected a string parameter");
+        }
+        return *value;
+    }
+    template <typename Writer>
+    static void encode(Writer &out, std::string_view value) {
+        out.string(value);
+    }
+};
+
+/* CommandDecoder has already decompressed a PAR_ZSTRING */
+template <> struct ParamCodec<schema::Text> {
+    static constexpr bool optional = false;
+    static std::string_view decode(const std::vector<Param> &params, std::size_t i) {
+        return ParamCodec<schema::Str>::decode(params, i);
+    }
+    template <typename Writer>
+    static void encode(Writer &out, std::string_view value) {
+        out.text(value);
+    }
+};
+
+template <typename Item> struct ParamCodec<schema::Opt<Item>> {
+    static constexpr bool optional = true;
+    static param_t<schema::Opt<Item>> decode(const std::vector<Param> &params, std::size_t i) {
+        if (i >= params.size()) {
+            return std::nullopt;
+        }
+        return ParamCodec<Item>::decode(params, i);
+    }
+    template <typename Writer, typename T>
+    static void encode(Writer &out, const std::optional<T> &value) {
+        if (value.has_value()) {
+            ParamCodec<Item>::encode(out, *value);
+        }
+    }
+};
+
+template <typename C> struct RequestCodec;
+
+template <Protocol Code, typename... Params, typename AnswerType>
+struct RequestCodec<schema::Command<schema::Request<Code, Params...>, AnswerType>> {
+    static constexpr Protocol code = Code;
+    static constexpr std::size_t max_params = sizeof...(Params);
+    static constexpr std::size_t min_params = (std::size_t{0} + ... + (ParamCodec<Params>::optional ? 0 : 1));
+    using Values = std::tuple<param_t<Params>...>;
+
+    static Values decode(const std::vector<Param> &params) {
+        if (params.size() < min_params || params.size() > max_params) {
+            throw std::runtime_error("Wrong number of parameters for command " +
+                                     std::to_string(static_cast<int>(Code)));
+        }
+        return [&]<std::size_t... I>(std::index_sequence<I...>) {
+            return Values{ParamCodec<Params>::decode(params, I)...};
+        }(std::index_sequence_for<Params...>{});
+    }
+
+    template <typename Writer, typename... Args>
+    static void encode(Writer &out, const Args &...args) {
+        static_assert(sizeof...(Args) == sizeof...(Params), "wrong number of parameters for command");
+        out.command(Code);
+        (ParamCodec<Params>::encode(out, args), ...);
+        out.command(Protocol::COM_END);
+    }
+};
+
+/* Checks the parameters of a decoded command of type C */
+template <typename C>
+void checkRequest(const Command &command) {
+    RequestCodec<C>::decode(command.parameters);
+}
+
+/* Checks the parameters of any command in the schema. Throws
+   std::runtime_error for an unknown command */
+template <typename... Cs>
+void checkRequest(schema::CommandList<Cs...>, const Command &command) {
+    bool known = ((command.commandType == RequestCodec<Cs>::code ? (checkRequest<Cs>(command), true) : false) ||
+                  ...);
+    if (!known) {
+        throw std::runtime_error("Unknown command " + std::to_string(static_cast<int>(command.commandType)));
+    }
+}
+
+/* The parameters of a command of type C, in schema order */
+template <typename C>
+typename RequestCodec<C>::Values decodeRequest(const Command &command) {
+    return RequestCodec<C>::decode(command.parameters);
+}
+
+/* Writes a command of type C with the given parameters, ending with COM_END */
+template <typename C, typename Writer, typename... Args>
+void encodeRequest(Writer &out, const Args &...args) {
+    RequestCodec<C>::encode(out, args...);
+}
+
+/* ---- answers ---- */
+
+template <typename Item> struct ItemCodec;
+
+template <> struct ItemCodec<schema::Num> {
+    template <typename Writer, typename V>
+    static void encode(Writer &out, V &&value) {
+        out.number(static_cast<int>(value));
+    }
+    template <typename Reader>
+    static int decode(Reader &in) {
+        return in.number();
+    }
+};
+
+template <> struct ItemCodec<schema::Str> {
+    /* Anything the writer accepts as a string, e.g. a moved string */
+    template <typename Writer, typename V>
+    static void encode(Writer &out, V &&value) {
+        out.string(std::forward<V>(value));
+    }
+    template <typename Reader>
+    static std::string decode(Reader &in) {
+        return in.string();
+    }
+};
+
+template <> struct ItemCodec<schema::Text> {
+    template <typename Writer, typename V>
+    static void encode(Writer &out, V &&value) {
+        out.text(std::forward<V>(value));
+    }
+    template <typename Reader>
+    static std::string decode(Reader &in) {
+        return in.string();
+    }
+};
+
+/* Encodes and decodes Items as elements of a tuple-like value; a single
+   item is the value itself */
+template <typename... Items> struct GroupCodec {
+    template <typename Writer, typename V>
+    static void encode(Writer &out, V &&values) {
+        [&]<std::size_t... I>(std::index_sequence<I...>) {
+            (ItemCodec<Items>::encode(out, std::get<I>(std::forward<V>(values))), ...);
+        }(std::index_sequence_for<Items...>{});
+    }
+    /* Braced initialization reads the items in order */
+    template <typename Value, typename Reader>
+    static Value decode(Reader &in) {
+        return Value{ItemCodec<Items>::decode(in)...};
+    }
+};
+
+template <typename Item> struct GroupCodec<Item> {
+    template <typename Writer, typename V>
+    static void encode(Writer &out, V &&value) {
+        ItemCodec<Item>::encode(out, std::forward<V>(value));
+    }
+    template <typename Value, typename Reader>
+    static Value decode(Reader &in) {
+        return ItemCodec<Item>::decode(in);
+    }
+};
+
+template <typename... Items> struct ItemCodec<schema::List<Items...>> {
+    template <typename Writer, typename V>
+    static void encode(Writer &out, V &&rows) {
+        out.number(static_cast<int>(rows.size()));
+        for (auto &row : rows) {
+            GroupCodec<Items...>::encode(out, row);
+        }
+    }
+    template <typename Reader>
+    static value_t<schema::List<Items...>> decode(Reader &in) {
+        int size = in.number();
+        if (size < 0) {
+            throw std::runtime_error("Negative list size " + std::to_string(size));
+        }
+        value_t<schema::List<Items...>> rows;
+        rows.reserve(size);
+        for (int i = 0; i != size; ++i) {
+            rows.push_back(GroupCodec<Items...>::template decode<typename Row<Items...>::type>(in));
+        }
+        return rows;
+    }
+};
+
+template <Protocol... Codes, typename... Items> struct ItemCodec<schema::Ack<schema::Errors<Codes...>, Items...>> {
+    /* value is a Nak, or a bool without items, otherwise something that
+       is false for ANS_NAK and dereferences to the items. A false value
+       stands for the error code of an Ack that has only one */
+    template <typename Writer, typename V>
+    static void encode(Writer &out, V &&value) {
+        if constexpr (std::is_same_v<std::remove_cvref_t<V>, Nak>) {
+            if (((value.error != Codes) && ...)) {
+                throw std::logic_error("Error code " + std::to_string(static_cast<int>(value.error)) +
+                                       " is not in the schema");
+            }
+            out.command(Protocol::ANS_NAK);
+            out.command(value.error);
+        } else if (!value) {
+            if constexpr (sizeof...(Codes) == 1) {
+                out.command(Protocol::ANS_NAK);
+                out.command(Codes...);
+            } else {
+                throw std::logic_error("An Ack with several error codes needs a Nak");
+            }
+        } else {
+            out.command(Protocol::ANS_ACK);
+            if constexpr (sizeof...(Items) > 0) {
+                GroupCodec<Items...>::encode(out, *std::forward<V>(value));
+            }
+        }
+    }
+    template <typename Reader>
+    static value_t<schema::Ack<schema::Errors<Codes...>, Items...>> decode(Reader &in) {
+        Protocol answer = in.code();
+        if (answer == Protocol::ANS_NAK) {
+            expectError<Codes...>(in);
+            return {};
+        }
+        if (answer != Protocol::ANS_ACK) {
+            throw std::runtime_error("Expected ANS_ACK or ANS_NAK, got " + std::to_string(static_cast<int>(answer)));
+        }
+        if constexpr (sizeof...(Items) == 0) {
+            return true;
+        } else {
+            return GroupCodec<Items...>::template decode<group_t<Items...>>(in);
+        }
+    }
+};
+
+template <Protocol... Codes, typename... Items>
+struct ItemCodec<schema::IfModified<schema::Errors<Codes...>, Items...>> {
+    /* value is a Nak, or has the status and value of a Fetched; the value
+       may be a tuple of anything the items accept. Missing stands for the
+       error code of an IfModified that has only one */
+    template <typename Writer, typename V>
+    static void encode(Writer &out, V &&fetched) {
+        if constexpr (std::is_same_v<std::remove_cvref_t<V>, Nak>) {
+            ItemCodec<schema::Ack<schema::Errors<Codes...>>>::encode(out, fetched);
+        } else {
+            switch (fetched.status) {
+            case FetchStatus::Found:
+                out.command(Protocol::ANS_ACK);
+                GroupCodec<Items...>::encode(out, std::forward<V>(fetched).value);
+                break;
+            case FetchStatus::NotModified:
+                out.command(Protocol::ANS_NOT_MODIFIED);
+                break;
+            case FetchStatus::Missing:
+                if constexpr (sizeof...(Codes) == 1) {
+                    out.command(Protocol::ANS_NAK);
+                    out.command(Codes...);
+                } else {
+                    throw std::logic_error("An IfModified with several error codes needs a Nak");
+                }
+                break;
+            }
+        }
+    }
+    template <typename Reader>
+    static value_t<schema::IfModified<schema::Errors<Codes...>, Items...>> decode(Reader &in) {
+        value_t<schema::IfModified<schema::Errors<Codes...>, Items...>> fetched{};
+        Protocol answer = in.code();
+        if (answer == Protocol::ANS_ACK) {
+            fetched.status = FetchStatus::Found;
+            fetched.value = GroupCodec<Items...>::template decode<group_t<Items...>>(in);
+        } else if (answer == Protocol::ANS_NOT_MODIFIED) {
+            fetched.status = FetchStatus::NotModified;
+        } else if (answer == Protocol::ANS_NAK) {
+            expectError<Codes...>(in);
+            fetched.status = FetchStatus::Missing;
+        } else {
+            throw std::runtime_error("Expected ANS_ACK, ANS_NOT_MODIFIED or ANS_NAK, got " +
+                                     std::to_string(static_cast<int>(answer)));
+        }
+        return fetched;
+    }
+};
+
+template <typename C> struct AnswerCodec;
+
+template <typename RequestType, Protocol Code, typename... Items>
+struct AnswerCodec<schema::Command<RequestType, schema::Answer<Code, Items...>>> {
+    template <typename Writer, typename V>
+    static void encode(Writer &out, V &&value) {
+        out.command(Code);
+        GroupCodec<Items...>::encode(out, std::forward<V>(value));
+        out.command(Protocol::ANS_END);
+    }
+    template <typename Reader>
+    static group_t<Items...> decode(Reader &in) {
+        expectCode(in, Code);
+        auto value = GroupCodec<Items...>::template decode<group_t<Items...>>(in);
+        expectCode(in, Protocol::ANS_END);
+        return value;
+    }
+};
+
+/* Writes the answer to a command of type C, from ANS_... to ANS_END */
+template <typename C, typename Writer, typename V>
+void encodeAnswer(Writer &out, V &&value) {
+    AnswerCodec<C>::encode(out, std::forward<V>(value));
+}
+
+/* Reads the answer to a command of type C */
+template <typename C, typename Reader>
+answer_t<C> decodeAnswer(Reader &in) {
+    return AnswerCodec<C>::decode(in);
+}
+
+} // namespace codec
+
+#endif
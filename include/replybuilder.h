@@ -0,0 +1,96 @@
+#ifndef REPLY_BUILDER_H
+#define REPLY_BUILDER_H
+
+#include "connection.h"
+#include "protocol.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <sys/types.h> /* off_t */
+#include <sys/uio.h>   /* iovec */
+#include <vector>
+
+/*
+ * Encodes a whole answer before it is written, so that it reaches the
+ * socket with one writev() instead of a write per item. It is a Writer
+ * for the encoders in protocolcodec.h. Small items are
+ * copied into one buffer; long strings that are moved in and file
+ * ranges are kept as separate pieces. The buffers are kept between
+ * answers, so one builder per connection can be reused.
+ */
+class ReplyBuilder {
+public:
+    /* Appends a command, answer or error code */
+    void command(Protocol code);
+
+    /* Appends a PAR_NUM parameter */
+    void number(int value);
+
+    /* 'length' bytes of the open file fd, starting at 'offset' */
+    struct FileRange {
+        int fd;
+        off_t offset;
+        std::size_t length;
+    };
+
+    /* Appends a PAR_STRING parameter */
+    void string(std::string_view s);
+    void string(std::string &&s);
+
+    /* Appends a PAR_STRING parameter whose characters are read from a
+       file. The file must stay open until the answer has been written */
+    void string(const FileRange &range);
+
+    /* Appends a PAR_ZSTRING parameter if compression is on and s is long
+       enough to gain from it, otherwise a PAR_STRING. File ranges are
+       never compressed */
+    void text(std::string_view s);
+    void text(std::string &&s);
+    void text(const FileRange &range);
+
+    /* Turns compression of text() on or off, for the answers of a
+       connection that has agreed on feature::compression */
+    void setCompression(bool on);
+
+    /* Returns the number of bytes of the answer */
+    std::size_t size() const;
+
+    /* Writes the answer to conn, see Connection::writeAll(). The
+       builder is cleared, also if writing throws */
+    void writeTo(const Connection &conn);
+
+    /* Removes the answer, keeping the allocated buffers */
+    void clear();
+
+private:
+    /* Strings at least this long are not copied if they are moved in */
+    static constexpr std::size_t copy_limit{4096};
+
+    /* A string or file range that goes after buffer[0 .. at - 1] */
+    struct Piece {
+        std::size_t at;
+        std::size_t body;
+        int fd;
+        off_t offset;
+        std::size_t length;
+    };
+
+    std::vector<unsigned char> buffer;
+    std::vector<std::string> bodies;
+    std::vector<Piece> pieces;
+    std::vector<iovec> iovecs;
+    bool compressing{false};
+
+    /* Appends the 4-byte representation of n */
+    void appendNumber(std::size_t n);
+
+    /* Appends the characters of s, keeping long ones as a piece */
+    void appendBody(std::string &&s);
+
+    /* Appends s compressed if that makes it shorter. Returns false if
+       nothing was appended */
+    bool appendCompressed(std::string_view s);
+};
+
+#endif
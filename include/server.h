@@ -30,14 +30,24 @@
 
 #include "connection.h"
 
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 /* A server listens to a port and handles multiple connections */
 class Server {
 public:
-    /* Creates a server that listens to a port */
-    explicit Server(int port);
+    /* Creates a server that listens to a port. At most 'backlog'
+       clients can wait to be accepted. With reuse_port, several
+       servers (one per event loop thread) may listen to the same
+       port, and the kernel spreads new clients among them */
+    explicit Server(int port, int backlog = default_backlog,
+                    bool reuse_port = false);
 
     /* Removes all registered connections */
     virtual ~Server();
@@ -45,17 +55,41 @@ public:
     /* Returns true if the server has been initialized correctly */
     bool isReady() const;
 
-    /* Waits for activity on the port. Returns a previously registered
-       connection object if an existing client wishes to communicate,
-       nullptr if a new client wishes to communicate */
-    std::shared_ptr<Connection> waitForActivity() const;
+    /* Waits for activity on the port. Returns a registered connection
+       object when an existing client wishes to communicate. New clients
+       are accepted and registered while waiting */
+    std::shared_ptr<Connection> waitForActivity();
 
-    /* Registers a new connection */
+    /* Waits for activity on the port. Returns all connections that
+       are ready after one wakeup */
+    std::vector<std::shared_ptr<Connection>> waitForActivities();
+
+    /* Sets the function that creates the Connection object for each
+       accepted client. The default creates a plain Connection */
+    void setConnectionFactory(std::function<std::shared_ptr<Connection>()> factory);
+
+    /* Registers a connection whose socket is open. Clients accepted
+       by the server are registered automatically. The socket is made
+       non-blocking */
     void registerConnection(const std::shared_ptr<Connection> &conn);
 
     /* Deregisters a connection */
     void deregisterConnection(const std::shared_ptr<Connection> &conn);
 
+    /* While 'on', the connection is also returned as active when its
+       socket can be written without blocking */
+    void watchWritable(const std::shared_ptr<Connection> &conn, bool on);
+
+    /* While 'on', the connection is not returned because of input.
+       Input that has not been read stays in the socket, so the
+       client is slowed down when the socket buffers are full */
+    void pauseReading(const std::shared_ptr<Connection> &conn, bool on);
+
+    /* Runs task on the thread that waits for activity, during its next
+       wait. Unlike the other functions, post() may be called from any
+       thread, e.g. by a worker that has served a connection */
+    void post(std::function<void()> task);
+
     /* Servers cannot be copied or assigned*/
     Server(const Server &) = delete;
     Server &operator=(const Server &) = delete;
@@ -63,18 +97,102 @@ public:
 
     /* Servers can be move constructed */
     Server(Server &&o) : my_socket{o.my_socket},
+                         epoll_fd{o.epoll_fd},
+                         wake_fd{o.wake_fd},
                          connections(std::move(o.connections)),
-                         pending_socket{o.pending_socket} {}
+                         connection_factory(std::move(o.connection_factory)),
+                         ready_sockets(std::move(o.ready_sockets)),
+                         returned_sockets(std::move(o.returned_sockets)),
+                         writable_sockets(std::move(o.writable_sockets)),
+                         paused_sockets(std::move(o.paused_sockets)),
+                         accept_paused{o.accept_paused},
+                         accept_retry{o.accept_retry},
+                         posted(std::move(o.posted)) {
+        o.my_socket = Connection::no_socket;
+        o.epoll_fd = Connection::no_socket;
+        o.wake_fd = Connection::no_socket;
+    }
+
+    /* Backlog used when none is given to the constructor */
+    static constexpr int default_backlog{1024};
+
+    /* How long accepting stays paused after accept() has failed for
+       lack of resources, unless a connection is deregistered first */
+    static constexpr std::chrono::milliseconds accept_retry_delay{1000};
 
 protected:
     /* The number of the communication socket */
     int my_socket{Connection::no_socket};
 
-    /* List of registered connections */
-    std::vector<std::shared_ptr<Connection>> connections;
+    /* The epoll instance that watches my_socket and all registered
+       connections */
+    int epoll_fd{Connection::no_socket};
+
+    /* An eventfd that is signalled when a task has been posted */
+    int wake_fd{Connection::no_socket};
+
+    /* Maximum number of events fetched by one epoll_wait() */
+    static constexpr int max_events{256};
+
+    /* Registered connections, indexed by socket number */
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
+
+    /* Creates the Connection objects for accepted clients */
+    std::function<std::shared_ptr<Connection>()> connection_factory;
+
+    /* Sockets reported ready by epoll but not yet returned */
+    std::deque<int> ready_sockets;
+
+    /* Sockets returned since the last epoll_wait(). They may have
+       buffered input that epoll cannot report */
+    std::vector<int> returned_sockets;
+
+    /* Connections watched for writability, and connections whose
+       reading is paused */
+    std::unordered_set<int> writable_sockets;
+    std::unordered_set<int> paused_sockets;
+
+    /* Set while new clients are not accepted, since accept() has failed
+       for lack of descriptors or memory. They wait in the backlog until
+       a connection is deregistered or accept_retry has passed */
+    bool accept_paused{false};
+    std::chrono::steady_clock::time_point accept_retry;
+
+    /* Tasks posted by other threads, see post() */
+    std::mutex posted_mutex;
+    std::vector<std::function<void()>> posted;
+
+    /* Waits until ready_sockets is non-empty. Subclasses may wait
+       for activity by other means than epoll */
+    virtual void poll();
+
+    /* Starts and stops waiting for activity on a registered
+       connection */
+    virtual void watch(const std::shared_ptr<Connection> &conn);
+    virtual void unwatch(const std::shared_ptr<Connection> &conn);
+
+    /* Makes the kernel report the events selected for a registered
+       connection by watchWritable() and pauseReading() */
+    virtual void updateInterest(const std::shared_ptr<Connection> &conn);
+
+    /* Pops the next ready socket. If it is a registered connection it
+       is stored in conn and true is returned. Accepts all waiting
+       clients if it is the listening socket, and runs the posted
+       tasks if it is wake_fd */
+    bool nextActivity(std::shared_ptr<Connection> &conn);
+
+    /* Accepts and registers clients until none is waiting */
+    void acceptAll();
+
+    /* Resets wake_fd and runs the tasks posted so far */
+    void runPosted();
+
+    /* Stop and restart waiting for new clients */
+    virtual void pauseAccepting();
+    virtual void resumeAccepting();
 
-    /* Socket for a connection waiting to be registered */
-    mutable int pending_socket{Connection::no_socket};
+    /* Adds a connection with a non-blocking socket and watches it */
+    void addConnection(const std::shared_ptr<Connection> &conn);
 
     /* Prints error message and exita */
     void error(const char *msg) const;
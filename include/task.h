@@ -0,0 +1,70 @@
+// ------------------------------------------------------------------
+//
+//                                 Client/Server communication package
+//
+//                                                   Task header file
+//
+// A Task is the return type of a coroutine that handles a connection,
+// see AsyncConnection. The coroutine starts running when it is called
+// and runs until its first co_await that cannot complete at once.
+//
+// ------------------------------------------------------------------
+
+#ifndef TASK_H
+#define TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+class Task {
+public:
+    struct promise_type {
+        std::exception_ptr exception;
+
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        /* Runs until the first suspension when called, and stays
+           suspended at the end so that done() can be asked */
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    /* Destroys the coroutine, also if it is suspended */
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    /* Returns true if the coroutine has finished */
+    bool done() const { return !handle || handle.done(); }
+
+    /* Rethrows the exception that ended the coroutine, if any */
+    void result() const {
+        if (handle && handle.done() && handle.promise().exception) {
+            std::rethrow_exception(handle.promise().exception);
+        }
+    }
+
+    /* Tasks cannot be copied or assigned */
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    Task &operator=(Task &&) = delete;
+
+    /* Tasks can be move constructed */
+    Task(Task &&o) : handle{std::exchange(o.handle, nullptr)} {}
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : handle{h} {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+#endif
@@ -0,0 +1,52 @@
+// ------------------------------------------------------------------
+//
+//                                 Client/Server communication package
+//
+//                                             ThreadPool header file
+//
+// A ThreadPool runs submitted jobs on a fixed number of worker
+// threads, in the order they were submitted.
+//
+// ------------------------------------------------------------------
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    /* Starts 'threads' worker threads (at least one) */
+    explicit ThreadPool(std::size_t threads);
+
+    /* Runs the jobs already submitted, then stops the workers */
+    ~ThreadPool();
+
+    /* Queues a job to be run by one of the workers */
+    void submit(std::function<void()> job);
+
+    /* Returns the number of worker threads */
+    std::size_t size() const;
+
+    /* ThreadPools cannot be copied, assigned or moved */
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping{false};
+
+    /* Body of each worker thread */
+    void run();
+};
+
+#endif
@@ -0,0 +1,128 @@
+// ------------------------------------------------------------------
+//
+//                                 Client/Server communication package
+//
+//                                            UringServer header file
+//
+// A UringServer is a Server that uses io_uring instead of epoll. All
+// accepts and reads of one wakeup are submitted to the kernel with a
+// single system call, which also waits for the next completions.
+//
+// ------------------------------------------------------------------
+
+#ifndef URING_SERVER_H
+#define URING_SERVER_H
+
+#include "iouring.h"
+#include "server.h"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+class UringServer : public Server {
+public:
+    /* Creates a server that listens to a port, see Server. isReady()
+       is false if the kernel does not support io_uring */
+    explicit UringServer(int port, int backlog = default_backlog,
+                         bool reuse_port = false);
+
+    ~UringServer() override;
+
+    /* UringServers cannot be moved, the kernel holds pointers into
+       their connections */
+    UringServer(UringServer &&) = delete;
+
+protected:
+    /* Submits the pending accepts and reads and reaps completions
+       until some connection has received data */
+    void poll() override;
+
+    /* Starts a read into the connection's buffer */
+    void watch(const std::shared_ptr<Connection> &conn) override;
+
+    /* Cancels the connection's outstanding read */
+    void unwatch(const std::shared_ptr<Connection> &conn) override;
+
+    /* Polls the connection's socket for POLLOUT if it is watched for
+       writability, and starts a read unless reading is paused */
+    void updateInterest(const std::shared_ptr<Connection> &conn) override;
+
+    /* Cancels the outstanding accept and starts a timeout after which
+       accepting is resumed */
+    void pauseAccepting() override;
+
+    /* Submits a new accept */
+    void resumeAccepting() override;
+
+private:
+    /* Number of submission queue entries */
+    static constexpr unsigned ring_entries{1024};
+
+    /* Operation kinds, stored in the low bits of user_data below the
+       address of the connection the operation belongs to */
+    enum class Op : std::uint64_t { Accept = 1, Recv = 2, Cancel = 3, PollOut = 4, Timeout = 5, Wake = 6 };
+    static constexpr std::uint64_t op_mask{7};
+
+    /* The opcodes the server submits; without any of them it is not
+       ready */
+    static constexpr unsigned required_ops[]{IORING_OP_ACCEPT, IORING_OP_RECV,
+                                             IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL,
+                                             IORING_OP_TIMEOUT};
+
+    IoUring ring;
+
+    /* True while the kernel supports multishot accept */
+    bool multishot_accept{true};
+
+    /* True while an accept is outstanding */
+    bool accepting{false};
+
+    /* True while the timeout that resumes accepting is outstanding. The
+       kernel reads accept_timeout until it completes */
+    bool timing{false};
+    __kernel_timespec accept_timeout{};
+
+    /* Set by the destructor, which waits for all outstanding
+       operations to finish */
+    bool stopping{false};
+
+    /* Connections with a read in flight. The kernel writes into their
+       buffers, so they are kept alive until the read completes, even
+       after they have been deregistered. They are keyed by connection
+       rather than socket, since a closed socket's number may be reused
+       by a new client while the old operation is still in flight */
+    std::unordered_map<const Connection *, std::shared_ptr<Connection>> reading;
+
+    /* Connections with a poll for writability in flight. Polls are
+       one-shot and re-armed when the connection is returned to the
+       server */
+    std::unordered_map<const Connection *, std::shared_ptr<Connection>> polling;
+
+    /* Returns a submission queue entry, submitting the queued ones
+       first if the queue is full */
+    io_uring_sqe *nextSqe();
+
+    /* Queues an accept on the listening socket */
+    void submitAccept();
+
+    /* Queues a one-shot poll for the posting of tasks to wake_fd */
+    void submitWake();
+
+    /* Queues the timeout after which accepting is resumed */
+    void submitTimeout();
+
+    /* Queues a one-shot poll for POLLOUT on the connection's socket */
+    void submitPollOut(const std::shared_ptr<Connection> &conn);
+
+    /* Queues the cancellation of an outstanding operation of a
+       connection, or of the listening socket if conn is nullptr */
+    void submitCancel(Op op, const Connection *conn);
+
+    /* Handles one completion */
+    void complete(const io_uring_cqe &cqe);
+
+    static std::uint64_t userData(Op op, const Connection *conn);
+};
+
+#endif
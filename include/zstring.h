@@ -0,0 +1,32 @@
+#ifndef ZSTRING_H
+#define ZSTRING_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/*
+ * Compression of PAR_ZSTRING parameters. A PAR_ZSTRING is followed by
+ * the length of the original string and the length of the compressed
+ * characters (4 bytes each), and then the characters, in zlib format.
+ */
+namespace zstring {
+
+/* Shorter strings are not worth compressing */
+constexpr std::size_t threshold{1024};
+
+/* The longest original string accepted, so that a short message cannot
+   make the receiver allocate a lot of memory */
+constexpr std::size_t max_length{1 << 28};
+
+/* Returns s compressed, or nullopt if that does not make it shorter */
+std::optional<std::string> compress(std::string_view s);
+
+/* Returns the original of 'data', which must be 'length' characters
+   long. Throws std::runtime_error if it is not, or 'data' is corrupt */
+std::string decompress(std::string_view data, std::size_t length);
+
+} // namespace zstring
+
+#endif
@@ -0,0 +1,82 @@
+#include "ArticleTable.h"
+#include <algorithm>
+
+void ArticleTable::append(int id, std::string_view title, std::string_view author, std::string_view text, int version) {
+    ids.push_back(id);
+    deleted.push_back(false);
+    titles.push_back(strings.store(title));
+    bodies.push_back({version, intern(author), strings.store(text)});
+}
+
+std::string_view ArticleTable::intern(std::string_view author) {
+    auto it = authors.find(author);
+    if (it != authors.end()) {
+        return *it;
+    }
+    return *authors.insert(strings.store(author)).first;
+}
+
+bool ArticleTable::erase(int id) {
+    auto pos = find(id);
+    if (!pos.has_value()) {
+        return false;
+    }
+    deleted[*pos] = true;
+    ++deletedCount;
+    titles[*pos] = {};
+    bodies[*pos] = Body();
+    if (deletedCount * 2 > ids.size()) {
+        compact();
+    }
+    return true;
+}
+
+std::optional<std::size_t> ArticleTable::find(int id) const {
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id) {
+        return std::nullopt;
+    }
+    std::size_t pos = it - ids.begin();
+    if (deleted[pos]) {
+        return std::nullopt;
+    }
+    return pos;
+}
+
+std::vector<std::pair<int, std::string>> ArticleTable::list(std::optional<int> afterId, std::size_t limit) const {
+    std::vector<std::pair<int, std::string>> result;
+    std::size_t pos = 0;
+    if (afterId.has_value()) {
+        pos = std::upper_bound(ids.begin(), ids.end(), *afterId) - ids.begin();
+    }
+    result.reserve(std::min(limit, ids.size() - pos));
+    for (; pos != ids.size() && result.size() < limit; ++pos) {
+        if (!deleted[pos]) {
+            result.emplace_back(ids[pos], titles[pos]);
+        }
+    }
+    return result;
+}
+
+void ArticleTable::compact() {
+    // The live strings are copied to a new arena, and the old one, with
+    // the strings of the deleted articles, is freed
+    StringArena oldStrings = std::move(strings);
+    strings = StringArena();
+    authors.clear();
+    std::size_t kept = 0;
+    for (std::size_t pos = 0; pos != ids.size(); ++pos) {
+        if (deleted[pos]) {
+            continue;
+        }
+        ids[kept] = ids[pos];
+        titles[kept] = strings.store(titles[pos]);
+        bodies[kept] = {bodies[pos].version, intern(bodies[pos].author), strings.store(bodies[pos].text)};
+        ++kept;
+    }
+    ids.resize(kept);
+    deleted.assign(kept, false);
+    titles.resize(kept);
+    bodies.resize(kept);
+    deletedCount = 0;
+}
@@ -0,0 +1,197 @@
+#include "ConcurrentInMemoryDatabase.h"
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <utility>
+
+ConcurrentInMemoryDatabase::~ConcurrentInMemoryDatabase() {
+}
+
+ConcurrentInMemoryDatabase::Shard& ConcurrentInMemoryDatabase::shardOf(int newsgroupId) {
+    return shards[static_cast<unsigned>(newsgroupId) % shard_count];
+}
+
+const ConcurrentInMemoryDatabase::Shard& ConcurrentInMemoryDatabase::shardOf(int newsgroupId) const {
+    return shards[static_cast<unsigned>(newsgroupId) % shard_count];
+}
+
+ConcurrentInMemoryDatabase::NameShard& ConcurrentInMemoryDatabase::nameShardOf(std::string_view name) {
+    return names[std::hash<std::string_view>{}(name) % shard_count];
+}
+
+bool ConcurrentInMemoryDatabase::createNewsgroup(std::string_view name) {
+    // The name stays locked until the newsgroup is in place, so two
+    // newsgroups with the same name cannot be created at the same time
+    NameShard& nameShard = nameShardOf(name);
+    std::lock_guard nameLock(nameShard.mutex);
+    if (!nameShard.names.emplace(name).second) {
+        return false; // Newsgroup with this name already exists
+    }
+    int id = nextNewsgroupId.fetch_add(1, std::memory_order_relaxed);
+    {
+        Shard& shard = shardOf(id);
+        std::unique_lock lock(shard.mutex);
+        Newsgroup& newsgroup = shard.newsgroups.try_emplace(id).first->second;
+        newsgroup.id = id;
+        newsgroup.name = name;
+    }
+    newsgroupGeneration.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool ConcurrentInMemoryDatabase::deleteNewsgroup(int id) {
+    std::string name;
+    {
+        Shard& shard = shardOf(id);
+        std::unique_lock lock(shard.mutex);
+        auto it = shard.newsgroups.find(id);
+        if (it == shard.newsgroups.end()) {
+            return false; // No newsgroup with this ID found
+        }
+        name = std::move(it->second.name);
+        shard.newsgroups.erase(it);
+    }
+    newsgroupGeneration.fetch_add(1, std::memory_order_release);
+    // The name is released last, so it cannot be reused while the old
+    // newsgroup still exists
+    NameShard& nameShard = nameShardOf(name);
+    std::lock_guard nameLock(nameShard.mutex);
+    nameShard.names.erase(name);
+    return true;
+}
+
+std::vector<std::pair<int, std::string>> ConcurrentInMemoryDatabase::listNewsgroups() const {
+    return *newsgroupListing();
+}
+
+Database::Listing ConcurrentInMemoryDatabase::newsgroupListing() const {
+    std::uint64_t generation = newsgroupGeneration.load(std::memory_order_acquire);
+    auto snapshot = newsgroupSnapshot.load(std::memory_order_acquire);
+    if (snapshot == nullptr || snapshot->generation < generation) {
+        auto fresh = std::make_shared<NewsgroupSnapshot>();
+        fresh->generation = generation;
+        for (const Shard& shard : shards) {
+            std::shared_lock lock(shard.mutex);
+            for (const auto& ng : shard.newsgroups) {
+                fresh->newsgroups.push_back({ng.first, ng.second.name});
+            }
+        }
+        std::sort(fresh->newsgroups.begin(), fresh->newsgroups.end());
+        // Published unless a reader has published a newer one meanwhile
+        snapshot = fresh;
+        auto current = newsgroupSnapshot.load(std::memory_order_acquire);
+        while ((current == nullptr || current->generation < generation) &&
+               !newsgroupSnapshot.compare_exchange_weak(current, snapshot, std::memory_order_acq_rel)) {
+        }
+    }
+    // Shares the ownership of the snapshot
+    return Listing(snapshot, &snapshot->newsgroups);
+}
+
+bool ConcurrentInMemoryDatabase::createArticle(int newsgroupId, std::string_view title, std::string_view author, std::string_view text) {
+    int version = hashVersion({title, author, text});
+    Shard& shard = shardOf(newsgroupId);
+    std::unique_lock lock(shard.mutex);
+    auto it = shard.newsgroups.find(newsgroupId);
+    if (it == shard.newsgroups.end()) {
+        return false; // No newsgroup with this ID
+    }
+    // Taken under the lock, so that the ids of a newsgroup grow
+    int id = nextArticleId.fetch_add(1, std::memory_order_relaxed);
+    it->second.articles.append(id, title, author, text, version);
+    it->second.listing.store(nullptr, std::memory_order_release);
+    return true;
+}
+
+Database::ArticleStatus ConcurrentInMemoryDatabase::deleteArticle(int newsgroupId, int articleId) {
+    Shard& shard = shardOf(newsgroupId);
+    std::unique_lock lock(shard.mutex);
+    auto it = shard.newsgroups.find(newsgroupId);
+    if (it == shard.newsgroups.end()) {
+        return ArticleStatus::NoNewsgroup;
+    }
+    if (!it->second.articles.erase(articleId)) {
+        return ArticleStatus::NoArticle;
+    }
+    it->second.listing.store(nullptr, std::memory_order_release);
+    return ArticleStatus::Found;
+}
+
+std::tuple<Database::ArticleStatus, std::string, std::string, std::string> ConcurrentInMemoryDatabase::getArticle(int newsgroupId, int articleId) const {
+    const Shard& shard = shardOf(newsgroupId);
+    std::shared_lock lock(shard.mutex);
+    auto ng_it = shard.newsgroups.find(newsgroupId);
+    if (ng_it == shard.newsgroups.end()) {
+        return {ArticleStatus::NoNewsgroup, "", "", ""};
+    }
+    const auto& articles = ng_it->second.articles;
+    auto pos = articles.find(articleId);
+    if (!pos.has_value()) {
+        return {ArticleStatus::NoArticle, "", "", ""};
+    }
+    return {ArticleStatus::Found, std::string(articles.title(*pos)), std::string(articles.author(*pos)), std::string(articles.text(*pos))};
+}
+
+std::pair<Database::ArticleStatus, int> ConcurrentInMemoryDatabase::getArticleVersion(int newsgroupId, int articleId) const {
+    const Shard& shard = shardOf(newsgroupId);
+    std::shared_lock lock(shard.mutex);
+    auto ng_it = shard.newsgroups.find(newsgroupId);
+    if (ng_it == shard.newsgroups.end()) {
+        return {ArticleStatus::NoNewsgroup, 0};
+    }
+    auto pos = ng_it->second.articles.find(articleId);
+    if (!pos.has_value()) {
+        return {ArticleStatus::NoArticle, 0};
+    }
+    return {ArticleStatus::Found, ng_it->second.articles.version(*pos)};
+}
+
+std::optional<std::vector<std::pair<int, std::string>>> ConcurrentInMemoryDatabase::listArticles(int newsgroupId) const {
+    auto listing = articleListing(newsgroupId);
+    if (listing == nullptr) {
+        return std::nullopt; // No newsgroup with this ID
+    }
+    return *listing;
+}
+
+std::optional<std::vector<std::pair<int, std::string>>> ConcurrentInMemoryDatabase::listArticles(int newsgroupId, std::optional<int> afterId, std::size_t limit) const {
+    const Shard& shard = shardOf(newsgroupId);
+    std::shared_lock lock(shard.mutex);
+    auto ng_it = shard.newsgroups.find(newsgroupId);
+    if (ng_it == shard.newsgroups.end()) {
+        return std::nullopt; // No newsgroup with this ID
+    }
+
+    // A page is copied from the listing if there is one, since it is
+    // ordered by id, and otherwise from the articles, without building it
+    const Newsgroup& newsgroup = ng_it->second;
+    auto listing = newsgroup.listing.load(std::memory_order_acquire);
+    if (listing == nullptr) {
+        return newsgroup.articles.list(afterId, limit);
+    }
+    auto first = listing->begin();
+    if (afterId.has_value()) {
+        first = std::upper_bound(listing->begin(), listing->end(), *afterId,
+                                 [](int id, const auto& article) { return id < article.first; });
+    }
+    auto last = first + std::min<std::size_t>(limit, listing->end() - first);
+    return std::vector<std::pair<int, std::string>>(first, last);
+}
+
+Database::Listing ConcurrentInMemoryDatabase::articleListing(int newsgroupId) const {
+    const Shard& shard = shardOf(newsgroupId);
+    std::shared_lock lock(shard.mutex);
+    auto ng_it = shard.newsgroups.find(newsgroupId);
+    if (ng_it == shard.newsgroups.end()) {
+        return nullptr; // No newsgroup with this ID
+    }
+
+    const Newsgroup& newsgroup = ng_it->second;
+    auto listing = newsgroup.listing.load(std::memory_order_acquire);
+    if (listing == nullptr) {
+        listing = std::make_shared<const std::vector<std::pair<int, std::string>>>(
+            newsgroup.articles.list(std::nullopt, newsgroup.articles.size()));
+        newsgroup.listing.store(listing, std::memory_order_release);
+    }
+    return listing;
+}
@@ -8,38 +8,74 @@
 #include <optional>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <chrono>
+#include <iterator>
+#include <queue>
+#include <charconv>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 DiskDatabase::DiskDatabase(const std::string& rootPath) : dbRoot(rootPath) {
     if (!std::filesystem::exists(dbRoot)) {
         std::filesystem::create_directories(dbRoot);
     }
+    for (const auto& entry : std::filesystem::directory_iterator(dbRoot)) {
+        if (entry.is_directory()) {
+            auto name = readName(entry.path());
+            if (name.has_value()) {
+                newsgroupIds.emplace(std::move(*name), std::stoi(entry.path().filename().string()));
+            }
+        }
+    }
+}
+
+// The name in the meta.txt of a newsgroup directory, nullopt if there is
+// none, e.g., if the newsgroup was being created when the server stopped
+std::optional<std::string> DiskDatabase::readName(const std::filesystem::path& newsgroupPath) {
+    std::ifstream in(newsgroupPath / "meta.txt");
+    std::string name;
+    if (std::getline(in, name) && name.starts_with("Name: ")) {
+        return name.substr(6);
+    }
+    return std::nullopt;
 }
 
 DiskDatabase::~DiskDatabase() {
 }
 
-bool DiskDatabase::createNewsgroup(const std::string& name) {
+bool DiskDatabase::createNewsgroup(std::string_view name) {
     if (name.empty()) {
         std::cerr << "Failed to create newsgroup: Name cannot be empty.\n";
         return false;
     }
-    int newsgroupId = std::hash<std::string>{}(name);
-    auto newsgroupPath = dbRoot / std::to_string(newsgroupId);
-    if (!std::filesystem::exists(newsgroupPath)) {
-        std::filesystem::create_directory(newsgroupPath);
-        std::ofstream out(newsgroupPath / "meta.txt");
+    if (newsgroupIds.contains(std::string(name))) {
+        std::cerr << "Failed to create newsgroup: Name already exists.\n";
+        return false;
+    }
+    // Names whose hashes collide get the following free id
+    int newsgroupId = std::hash<std::string_view>{}(name);
+    while (!std::filesystem::create_directory(dbRoot / std::to_string(newsgroupId))) {
+        newsgroupId = static_cast<int>(static_cast<unsigned>(newsgroupId) + 1);
+    }
+    {
+        std::ofstream out(dbRoot / std::to_string(newsgroupId) / "meta.txt");
         out << "Name: " << name << std::endl;
-        std::cout << "Newsgroup created: " << name << " with ID " << newsgroupId << "\n";
-        return true;
     }
-    std::cerr << "Failed to create newsgroup: ID already exists.\n";
-    return false;
+    newsgroupIds.emplace(name, newsgroupId);
+    std::cout << "Newsgroup created: " << name << " with ID " << newsgroupId << "\n";
+    return true;
 }
 
 bool DiskDatabase::deleteNewsgroup(int id) {
     auto newsgroupPath = dbRoot / std::to_string(id);
     if (std::filesystem::exists(newsgroupPath)) {
+        auto name = readName(newsgroupPath);
+        if (name.has_value()) {
+            newsgroupIds.erase(*name);
+        }
         std::filesystem::remove_all(newsgroupPath);
         std::cout << "Newsgroup deleted: ID " << id << "\n";
         return true;
@@ -53,15 +89,14 @@ std::vector<std::pair<int, std::string>> DiskDatabase::listNewsgroups() const {
 
     for (const auto& entry : std::filesystem::directory_iterator(dbRoot)) {
         if (entry.is_directory()) {
-            std::ifstream in(entry.path() / "meta.txt");
-            std::string name;
-            if (std::getline(in, name) && name.starts_with("Name: ")) {
+            auto name = readName(entry.path());
+            if (name.has_value()) {
                 auto file_time = std::filesystem::last_write_time(entry);
                 auto sys_time = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
                 file_time - std::filesystem::file_time_type::clock::now() + std::chrono::system_clock::now()
             );
                 int id = std::stoi(entry.path().filename().string());
-                tempGroups.emplace_back(sys_time, id, name.substr(6));
+                tempGroups.emplace_back(sys_time, id, std::move(*name));
             }
         }
     }
@@ -79,12 +114,22 @@ std::vector<std::pair<int, std::string>> DiskDatabase::listNewsgroups() const {
 }
 
 
-bool DiskDatabase::createArticle(int newsgroupId, const std::string& title, const std::string& author, const std::string& text) {
+bool DiskDatabase::createArticle(int newsgroupId, std::string_view title, std::string_view author, std::string_view text) {
     auto path = dbRoot / std::to_string(newsgroupId);
     if (std::filesystem::exists(path)) {
-        int articleId = std::hash<std::string>{}(title + author + text);
-        std::ofstream out(path / (std::to_string(articleId) + ".txt"));
-        out << "Title: " << title << "\nAuthor: " << author << "\nText: " << text << std::endl;
+        std::string key;
+        key.reserve(title.size() + author.size() + text.size());
+        key.append(title).append(author).append(text);
+        int articleId = std::hash<std::string>{}(key);
+        // Write to a new file and rename it, so that readers holding the
+        // old file open (see getArticleFile) never see it change
+        auto articlePath = path / (std::to_string(articleId) + ".txt");
+        auto tmpPath = path / (std::to_string(articleId) + ".tmp");
+        {
+            std::ofstream out(tmpPath);
+            out << "Title: " << title << "\nAuthor: " << author << "\nText: " << text << std::endl;
+        }
+        std::filesystem::rename(tmpPath, articlePath);
         std::cout << "Article created: " << title << " with ID " << articleId << " in newsgroup " << newsgroupId << "\n";
         return true;
     }
@@ -92,28 +137,38 @@ bool DiskDatabase::createArticle(int newsgroupId, const std::string& title, cons
     return false;
 }
 
-bool DiskDatabase::deleteArticle(int newsgroupId, int articleId) {
+Database::ArticleStatus DiskDatabase::deleteArticle(int newsgroupId, int articleId) {
     auto articlePath = dbRoot / std::to_string(newsgroupId) / (std::to_string(articleId) + ".txt");
-    if (std::filesystem::exists(articlePath)) {
-        std::filesystem::remove(articlePath);
+    if (std::filesystem::remove(articlePath)) {
         std::cout << "Article deleted: ID " << articleId << " from newsgroup ID " << newsgroupId << "\n";
-        return true;
+        return ArticleStatus::Found;
     }
     std::cerr << "Failed to delete article: No such article ID.\n";
-    return false;
+    return missing(newsgroupId);
 }
 
-std::tuple<bool, std::string, std::string, std::string> DiskDatabase::getArticle(int newsgroupId, int articleId) const {
+Database::ArticleStatus DiskDatabase::missing(int newsgroupId) const {
+    if (std::filesystem::exists(dbRoot / std::to_string(newsgroupId))) {
+        return ArticleStatus::NoArticle;
+    }
+    return ArticleStatus::NoNewsgroup;
+}
+
+std::tuple<Database::ArticleStatus, std::string, std::string, std::string> DiskDatabase::getArticle(int newsgroupId, int articleId) const {
     auto articlePath = dbRoot / std::to_string(newsgroupId) / (std::to_string(articleId) + ".txt");
     if (std::filesystem::exists(articlePath)) {
         std::ifstream in(articlePath);
-        std::string title, author, text, line;
+        std::string title, author;
         std::getline(in, title);
         std::getline(in, author);
-        while (std::getline(in, line)) text += line + "\n";
-        return {true, title.substr(7), author.substr(8), text}; // Strip the prefixes "Title: " and "Author: "
+        std::string text{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+        // Strip the prefixes "Title: ", "Author: " and "Text: ", and the
+        // newline that ends the file
+        if (text.starts_with("Text: ")) text.erase(0, 6);
+        if (text.ends_with("\n")) text.pop_back();
+        return {ArticleStatus::Found, title.substr(7), author.substr(8), text};
     }
-    return {false, "", "", ""};
+    return {missing(newsgroupId), "", "", ""};
 }
 
 std::optional<std::vector<std::pair<int, std::string>>> DiskDatabase::listArticles(int newsgroupId) const {
@@ -121,7 +176,7 @@ std::optional<std::vector<std::pair<int, std::string>>> DiskDatabase::listArticl
     if (std::filesystem::exists(path)) {
         std::vector<std::pair<int, std::string>> articles;
         for (const auto& entry : std::filesystem::directory_iterator(path)) {
-            if (entry.is_regular_file()) {
+            if (entry.is_regular_file() && entry.path().extension() == ".txt") {
                 std::ifstream in(entry.path());
                 std::string title;
                 if (std::getline(in, title) && title.starts_with("Title: ")) {
@@ -136,3 +191,113 @@ std::optional<std::vector<std::pair<int, std::string>>> DiskDatabase::listArticl
     std::cerr << "Failed to list articles: No such newsgroup ID.\n";
     return std::nullopt;
 }
+
+std::optional<std::vector<std::pair<int, std::string>>> DiskDatabase::listArticles(int newsgroupId, std::optional<int> afterId, std::size_t limit) const {
+    auto path = dbRoot / std::to_string(newsgroupId);
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "Failed to list articles: No such newsgroup ID.\n";
+        return std::nullopt;
+    }
+
+    // Select the ids from the file names, keeping the smallest ones in a
+    // max-heap, and only open the files of the page
+    std::priority_queue<int> page;
+    for (const auto& entry : std::filesystem::directory_iterator(path)) {
+        if (limit == 0) {
+            break;
+        }
+        if (!entry.is_regular_file() || entry.path().extension() != ".txt") {
+            continue;
+        }
+        auto stem = entry.path().stem().string();
+        int id;
+        auto [end, ec] = std::from_chars(stem.data(), stem.data() + stem.size(), id);
+        if (ec != std::errc() || end != stem.data() + stem.size()) {
+            continue;
+        }
+        if (afterId.has_value() && id <= *afterId) {
+            continue;
+        }
+        if (page.size() < limit) {
+            page.push(id);
+        } else if (id < page.top()) {
+            page.pop();
+            page.push(id);
+        }
+    }
+
+    std::vector<int> ids(page.size());
+    for (auto it = ids.rbegin(); it != ids.rend(); ++it) {
+        *it = page.top();
+        page.pop();
+    }
+    // Articles deleted while the page is read are left out
+    std::vector<std::pair<int, std::string>> articles;
+    for (int id : ids) {
+        std::ifstream in(path / (std::to_string(id) + ".txt"));
+        std::string title;
+        if (std::getline(in, title) && title.starts_with("Title: ")) {
+            articles.emplace_back(id, title.substr(7));
+        }
+    }
+    std::cout << "Listing articles in newsgroup " << newsgroupId << ", page size: " << articles.size() << "\n";
+    return articles;
+}
+
+std::pair<Database::ArticleStatus, int> DiskDatabase::getArticleVersion(int newsgroupId, int articleId) const {
+    auto articlePath = dbRoot / std::to_string(newsgroupId) / (std::to_string(articleId) + ".txt");
+    struct stat st;
+    if (stat(articlePath.c_str(), &st) < 0) {
+        return {missing(newsgroupId), 0};
+    }
+    // Articles are replaced by renaming a new file over them, which
+    // gives them a new inode and modification time
+    std::uint64_t parts[] = {static_cast<std::uint64_t>(st.st_ino), static_cast<std::uint64_t>(st.st_mtim.tv_sec),
+                             static_cast<std::uint64_t>(st.st_mtim.tv_nsec), static_cast<std::uint64_t>(st.st_size)};
+    return {ArticleStatus::Found, hashVersion({std::string_view(reinterpret_cast<const char*>(parts), sizeof(parts))})};
+}
+
+std::optional<ArticleFile> DiskDatabase::getArticleFile(int newsgroupId, int articleId) const {
+    auto articlePath = dbRoot / std::to_string(newsgroupId) / (std::to_string(articleId) + ".txt");
+    int fd = open(articlePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    ArticleFile article(fd);
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return std::nullopt;
+    }
+
+    // Read the title and author lines, up to where the text starts
+    std::string header;
+    std::size_t titleEnd, authorEnd;
+    char chunk[4096];
+    while (true) {
+        titleEnd = header.find('\n');
+        authorEnd = titleEnd == std::string::npos ? std::string::npos : header.find('\n', titleEnd + 1);
+        if (authorEnd != std::string::npos && header.size() >= authorEnd + 7) {
+            break;
+        }
+        ssize_t n = pread(fd, chunk, sizeof(chunk), header.size());
+        if (n <= 0) {
+            return std::nullopt;
+        }
+        header.append(chunk, n);
+    }
+    if (!header.starts_with("Title: ") ||
+        header.compare(titleEnd + 1, 8, "Author: ") != 0 ||
+        header.compare(authorEnd + 1, 6, "Text: ") != 0) {
+        return std::nullopt;
+    }
+
+    article.title = header.substr(7, titleEnd - 7);
+    article.author = header.substr(titleEnd + 9, authorEnd - titleEnd - 9);
+    article.offset = authorEnd + 7;
+    if (st.st_size <= article.offset) {
+        return std::nullopt;
+    }
+    // The file ends with a newline that is not part of the text
+    article.length = st.st_size - article.offset - 1;
+    return article;
+}
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <algorithm>
 #include <optional>
+#include <utility>
 
 // id and newsgroup tuple
 InMemoryDatabase::~InMemoryDatabase() {
@@ -9,26 +10,29 @@ InMemoryDatabase::~InMemoryDatabase() {
     std::cout << "InMemoryDatabase destructor called.\n";
 }
 
-bool InMemoryDatabase::createNewsgroup(const std::string& name) {
-    for (const auto& ng : newsgroups) {
-        if (ng.second.name == name) {
-            std::cout << "Failed to create newsgroup, name already exists: " << name << "\n";
-            return false; // Newsgroup with this name already exists
-        }
+bool InMemoryDatabase::createNewsgroup(std::string_view name) {
+    auto [name_it, inserted] = newsgroupIds.try_emplace(std::string(name), nextNewsgroupId);
+    if (!inserted) {
+        std::cout << "Failed to create newsgroup, name already exists: " << name << "\n";
+        return false; // Newsgroup with this name already exists
     }
     Newsgroup newsgroup;
     newsgroup.id = nextNewsgroupId++;
-    newsgroup.name = name;
-    newsgroups[newsgroup.id] = newsgroup;
-    std::cout << "Newsgroup created: " << name << " with ID " << newsgroup.id << "\n";
+    newsgroup.name = name_it->first;
+    int id = newsgroup.id;
+    newsgroups[id] = std::move(newsgroup);
+    std::cout << "Newsgroup created: " << name << " with ID " << id << "\n";
     return true;
 }
 
 bool InMemoryDatabase::deleteNewsgroup(int id) {
-    if (newsgroups.erase(id) == 0) {
+    auto it = newsgroups.find(id);
+    if (it == newsgroups.end()) {
         std::cout << "Failed to delete newsgroup, no such ID: " << id << "\n";
         return false; // No newsgroup with this ID found
     }
+    newsgroupIds.erase(it->second.name);
+    newsgroups.erase(it);
     std::cout << "Newsgroup deleted: ID " << id << "\n";
     return true;
 }
@@ -43,67 +47,86 @@ std::vector<std::pair<int, std::string>> InMemoryDatabase::listNewsgroups() cons
     return result;
 }
 
-bool InMemoryDatabase::createArticle(int newsgroupId, const std::string& title, const std::string& author, const std::string& text) {
+bool InMemoryDatabase::createArticle(int newsgroupId, std::string_view title, std::string_view author, std::string_view text) {
     auto it = newsgroups.find(newsgroupId);
     if (it == newsgroups.end()) {
         std::cout << "Failed to create article, no such newsgroup ID: " << newsgroupId << "\n";
         return false; // No newsgroup with this ID
     }
 
-    Article article;
-    article.id = nextArticleId++;
-    article.title = title;
-    article.author = author;
-    article.text = text;
-    it->second.articles[article.id] = article;
-    std::cout << "Article created in newsgroup " << newsgroupId << ": " << title << " with ID " << article.id << "\n";
+    int id = nextArticleId++;
+    it->second.articles.append(id, title, author, text, hashVersion({title, author, text}));
+    std::cout << "Article created in newsgroup " << newsgroupId << ": " << title << " with ID " << id << "\n";
     return true;
 }
 
-bool InMemoryDatabase::deleteArticle(int newsgroupId, int articleId) {
+Database::ArticleStatus InMemoryDatabase::deleteArticle(int newsgroupId, int articleId) {
     auto it = newsgroups.find(newsgroupId);
     if (it == newsgroups.end()) {
         std::cout << "Failed to delete article, no such newsgroup ID: " << newsgroupId << "\n";
-        return false; // No newsgroup with this ID
+        return ArticleStatus::NoNewsgroup;
     }
 
     if (it->second.articles.erase(articleId) == 0) {
         std::cout << "Failed to delete article, no such article ID: " << articleId << "\n";
-        return false; // No article with this ID in the newsgroup
+        return ArticleStatus::NoArticle;
     }
 
     std::cout << "Article deleted: ID " << articleId << " from newsgroup ID " << newsgroupId << "\n";
-    return true;
+    return ArticleStatus::Found;
 }
 
-std::tuple<bool, std::string, std::string, std::string> InMemoryDatabase::getArticle(int newsgroupId, int articleId) const {
+std::tuple<Database::ArticleStatus, std::string, std::string, std::string> InMemoryDatabase::getArticle(int newsgroupId, int articleId) const {
     auto ng_it = newsgroups.find(newsgroupId);
     if (ng_it == newsgroups.end()) {
         std::cout << "No newsgroup found for ID: " << newsgroupId << "\n";
-        return {false, "", "", ""}; // No newsgroup with this ID
+        return {ArticleStatus::NoNewsgroup, "", "", ""};
     }
 
-    auto art_it = ng_it->second.articles.find(articleId);
-    if (art_it == ng_it->second.articles.end()) {
+    const auto& articles = ng_it->second.articles;
+    auto pos = articles.find(articleId);
+    if (!pos.has_value()) {
         std::cout << "No article found for ID: " << articleId << " in newsgroup ID: " << newsgroupId << "\n";
-        return {false, "", "", ""}; // No article with this ID
+        return {ArticleStatus::NoArticle, "", "", ""};
     }
 
-    std::cout << "Article retrieved: " << art_it->second.title << "\n";
-    return {true, art_it->second.title, art_it->second.author, art_it->second.text};
+    std::cout << "Article retrieved: " << articles.title(*pos) << "\n";
+    return {ArticleStatus::Found, std::string(articles.title(*pos)), std::string(articles.author(*pos)), std::string(articles.text(*pos))};
+}
+
+std::pair<Database::ArticleStatus, int> InMemoryDatabase::getArticleVersion(int newsgroupId, int articleId) const {
+    auto ng_it = newsgroups.find(newsgroupId);
+    if (ng_it == newsgroups.end()) {
+        return {ArticleStatus::NoNewsgroup, 0};
+    }
+    auto pos = ng_it->second.articles.find(articleId);
+    if (!pos.has_value()) {
+        return {ArticleStatus::NoArticle, 0};
+    }
+    return {ArticleStatus::Found, ng_it->second.articles.version(*pos)};
 }
 
 std::optional<std::vector<std::pair<int, std::string>>> InMemoryDatabase::listArticles(int newsgroupId) const {
-    std::vector<std::pair<int, std::string>> result;
     auto ng_it = newsgroups.find(newsgroupId);
     if (ng_it == newsgroups.end()) {
         std::cout << "No newsgroup found for listing articles, ID: " << newsgroupId << "\n";
-        return result; // No newsgroup with this ID
+        return std::nullopt; // No newsgroup with this ID
     }
 
-    for (const auto& article : ng_it->second.articles) {
-        result.push_back({article.first, article.second.title});
-    }
+    const auto& articles = ng_it->second.articles;
+    auto result = articles.list(std::nullopt, articles.size());
     std::cout << "Articles listed for newsgroup " << newsgroupId << ", count: " << result.size() << "\n";
     return result;
 }
+
+std::optional<std::vector<std::pair<int, std::string>>> InMemoryDatabase::listArticles(int newsgroupId, std::optional<int> afterId, std::size_t limit) const {
+    auto ng_it = newsgroups.find(newsgroupId);
+    if (ng_it == newsgroups.end()) {
+        std::cout << "No newsgroup found for listing articles, ID: " << newsgroupId << "\n";
+        return std::nullopt; // No newsgroup with this ID
+    }
+
+    auto result = ng_it->second.articles.list(afterId, limit);
+    std::cout << "Articles listed for newsgroup " << newsgroupId << ", page size: " << result.size() << "\n";
+    return result;
+}
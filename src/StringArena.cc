@@ -0,0 +1,26 @@
+#include "StringArena.h"
+#include <algorithm>
+#include <cstring>
+
+std::string_view StringArena::store(std::string_view s) {
+    if (s.empty()) {
+        return {};
+    }
+    if (s.size() > left) {
+        if (s.size() > max_block / 4) {
+            // The current block is kept for the short strings to come
+            blocks.push_back(std::make_unique_for_overwrite<char[]>(s.size()));
+            std::memcpy(blocks.back().get(), s.data(), s.size());
+            return {blocks.back().get(), s.size()};
+        }
+        blockSize = std::clamp(blockSize * 2, std::max(min_block, s.size()), max_block);
+        blocks.push_back(std::make_unique_for_overwrite<char[]>(blockSize));
+        next = blocks.back().get();
+        left = blockSize;
+    }
+    std::memcpy(next, s.data(), s.size());
+    std::string_view stored(next, s.size());
+    next += s.size();
+    left -= s.size();
+    return stored;
+}
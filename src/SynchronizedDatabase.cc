@@ -0,0 +1,67 @@
+#include "SynchronizedDatabase.h"
+#include <mutex>
+
+SynchronizedDatabase::SynchronizedDatabase(Database& backend) : db(backend) {}
+
+SynchronizedDatabase::~SynchronizedDatabase() {
+}
+
+bool SynchronizedDatabase::createNewsgroup(std::string_view name) {
+    std::unique_lock lock(mutex);
+    return db.createNewsgroup(name);
+}
+
+bool SynchronizedDatabase::deleteNewsgroup(int id) {
+    std::unique_lock lock(mutex);
+    return db.deleteNewsgroup(id);
+}
+
+std::vector<std::pair<int, std::string>> SynchronizedDatabase::listNewsgroups() const {
+    std::shared_lock lock(mutex);
+    return db.listNewsgroups();
+}
+
+bool SynchronizedDatabase::createArticle(int newsgroupId, std::string_view title, std::string_view author, std::string_view text) {
+    std::unique_lock lock(mutex);
+    return db.createArticle(newsgroupId, title, author, text);
+}
+
+Database::ArticleStatus SynchronizedDatabase::deleteArticle(int newsgroupId, int articleId) {
+    std::unique_lock lock(mutex);
+    return db.deleteArticle(newsgroupId, articleId);
+}
+
+std::tuple<Database::ArticleStatus, std::string, std::string, std::string> SynchronizedDatabase::getArticle(int newsgroupId, int articleId) const {
+    std::shared_lock lock(mutex);
+    return db.getArticle(newsgroupId, articleId);
+}
+
+std::optional<std::vector<std::pair<int, std::string>>> SynchronizedDatabase::listArticles(int newsgroupId) const {
+    std::shared_lock lock(mutex);
+    return db.listArticles(newsgroupId);
+}
+
+std::optional<std::vector<std::pair<int, std::string>>> SynchronizedDatabase::listArticles(int newsgroupId, std::optional<int> afterId, std::size_t limit) const {
+    std::shared_lock lock(mutex);
+    return db.listArticles(newsgroupId, afterId, limit);
+}
+
+Database::Listing SynchronizedDatabase::newsgroupListing() const {
+    std::shared_lock lock(mutex);
+    return db.newsgroupListing();
+}
+
+Database::Listing SynchronizedDatabase::articleListing(int newsgroupId) const {
+    std::shared_lock lock(mutex);
+    return db.articleListing(newsgroupId);
+}
+
+std::pair<Database::ArticleStatus, int> SynchronizedDatabase::getArticleVersion(int newsgroupId, int articleId) const {
+    std::shared_lock lock(mutex);
+    return db.getArticleVersion(newsgroupId, articleId);
+}
+
+std::optional<ArticleFile> SynchronizedDatabase::getArticleFile(int newsgroupId, int articleId) const {
+    std::shared_lock lock(mutex);
+    return db.getArticleFile(newsgroupId, articleId);
+}
@@ -0,0 +1,181 @@
+// ------------------------------------------------------------------
+//
+//                                 Client/Server communication package
+//
+//                                AsyncConnection implementation file
+//
+// ------------------------------------------------------------------
+
+#include "asyncconnection.h"
+
+#include "connectionclosedexception.h"
+#include "server.h"
+
+#include <utility>
+#include <vector>
+
+std::size_t AsyncConnection::low_water{16 * 1024};
+std::size_t AsyncConnection::high_water{256 * 1024};
+std::size_t AsyncConnection::total_limit{256 * 1024 * 1024};
+std::atomic<std::size_t> AsyncConnection::total_output{0};
+
+AsyncConnection::AsyncConnection(Handler h) : handler(std::move(h)) {
+    implicit_flush = false;
+}
+
+AsyncConnection::~AsyncConnection() {
+    total_output -= counted_output;
+}
+
+void AsyncConnection::setOutputLimits(std::size_t low, std::size_t high, std::size_t total) {
+    low_water = low;
+    high_water = high;
+    total_limit = total;
+}
+
+void AsyncConnection::countOutput() {
+    std::size_t size = write_buffer.size();
+    if (size > counted_output) {
+        total_output += size - counted_output;
+    } else {
+        total_output -= counted_output - size;
+    }
+    counted_output = size;
+}
+
+bool AsyncConnection::drained() {
+    tryFlush();
+    countOutput();
+    std::size_t left = write_buffer.size();
+    return left == 0 || (left <= low_water && total_output <= total_limit);
+}
+
+bool AsyncConnection::CommandAwaiter::await_ready() const {
+    return conn.closed || !conn.commands.empty();
+}
+
+void AsyncConnection::CommandAwaiter::await_suspend(std::coroutine_handle<> h) {
+    conn.waiting = h;
+    conn.wait = Wait::Command;
+}
+
+Command AsyncConnection::CommandAwaiter::await_resume() {
+    if (conn.closed) {
+        throw ConnectionClosedException();
+    }
+    Command command = std::move(conn.commands.front());
+    conn.commands.pop_front();
+    return command;
+}
+
+AsyncConnection::CommandAwaiter AsyncConnection::readCommand() {
+    return CommandAwaiter(*this);
+}
+
+bool AsyncConnection::SendAwaiter::await_ready() const {
+    /* While more commands wait, their answers are sent together */
+    if (!conn.closed && !conn.commands.empty() && conn.write_buffer.size() < low_water) {
+        return true;
+    }
+    return conn.closed || conn.drained();
+}
+
+void AsyncConnection::SendAwaiter::await_suspend(std::coroutine_handle<> h) {
+    conn.waiting = h;
+    conn.wait = Wait::Send;
+}
+
+void AsyncConnection::SendAwaiter::await_resume() const {
+    if (conn.closed) {
+        throw ConnectionClosedException();
+    }
+}
+
+AsyncConnection::SendAwaiter AsyncConnection::send() { return SendAwaiter(*this); }
+
+AsyncConnection::SendAwaiter AsyncConnection::send(const std::string &reply) {
+    writeAll(reply);
+    return SendAwaiter(*this);
+}
+
+bool AsyncConnection::canResume() {
+    if (closed) {
+        return true;
+    }
+    if (wait == Wait::Command) {
+        return !commands.empty();
+    }
+    try {
+        return drained();
+    } catch (ConnectionClosedException &) {
+        closed = true;
+        return true;
+    }
+}
+
+bool AsyncConnection::onActivity(Server &server) {
+    try {
+        if (!reading_paused) {
+            auto input = readAvailable();
+            std::vector<Command> decoded;
+            decoder.feed(input, decoded);
+            consume(input.size());
+            for (auto &command : decoded) {
+                commands.push_back(std::move(command));
+            }
+        }
+        /* Output left behind by earlier answers is sent in the
+           background */
+        tryFlush();
+    } catch (ConnectionClosedException &) {
+        closed = true;
+    }
+
+    if (!task) {
+        task.emplace(handler(*this));
+    }
+    while (waiting && canResume()) {
+        wait = Wait::Nothing;
+        std::exchange(waiting, nullptr).resume();
+    }
+    if (!closed) {
+        try {
+            tryFlush();
+        } catch (ConnectionClosedException &) {
+            closed = true;
+        }
+    }
+
+    bool finished = task->done();
+    if (finished) {
+        task->result();
+        if (!closed && !tryFlush()) {
+            /* Send the last answer before closing the connection */
+            finished = false;
+        }
+    }
+
+    countOutput();
+    if (closed) {
+        return false;
+    }
+
+    /* Writability is only interesting while output is waiting. Input
+       is left in the socket while too much output or too many
+       commands wait; since output is waiting then, the connection is
+       returned again when some of it can be sent */
+    std::size_t output = write_buffer.size();
+    bool want_writable = output > 0;
+    bool pause = output > high_water ||
+                 (output > 0 && total_output > total_limit) ||
+                 (output > 0 && commands.size() >= command_limit);
+    if (want_writable != watching_writable) {
+        server.watchWritable(shared_from_this(), want_writable);
+        watching_writable = want_writable;
+    }
+    if (pause != reading_paused) {
+        server.pauseReading(shared_from_this(), pause);
+        reading_paused = pause;
+    }
+    return !finished;
+}
@@ -0,0 +1,132 @@
+#include "commanddecoder.h"
+
+#include "protocolcodec.h"
+#include "zstring.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+/* Strings longer than this are not reserved for in advance, they grow
+   as their characters arrive */
+constexpr std::size_t max_reserve = 1 << 20;
+}
+
+void CommandDecoder::feed(std::span<const unsigned char> data, std::vector<Command> &commands) {
+    std::size_t pos = 0;
+    while (pos < data.size()) {
+        switch (state) {
+        case State::CommandType:
+            commandType = static_cast<Protocol>(data[pos++]);
+            params.clear();
+            state = State::ParamType;
+            break;
+        case State::ParamType: {
+            Protocol paramType = static_cast<Protocol>(data[pos++]);
+            if (paramType == Protocol::COM_END) {
+                complete(commands);
+                state = State::CommandType;
+            } else if (paramType == Protocol::PAR_NUM) {
+                state = State::NumberParam;
+            } else if (paramType == Protocol::PAR_STRING) {
+                compressed = false;
+                state = State::StringLength;
+            } else if (paramType == Protocol::PAR_ZSTRING) {
+                compressed = true;
+                state = State::ZStringLength;
+            } else {
+                throw std::runtime_error("Unknown parameter type");
+            }
+            break;
+        }
+        case State::NumberParam:
+            if (addNumberByte(data[pos++])) {
+                params.push_back(Param(Protocol::PAR_NUM, static_cast<int>(number)));
+                state = State::ParamType;
+            }
+            break;
+        case State::ZStringLength:
+            if (addNumberByte(data[pos++])) {
+                if (number > zstring::max_length) {
+                    throw std::runtime_error("Compressed string too long");
+                }
+                originalLength = number;
+                state = State::StringLength;
+            }
+            break;
+        case State::StringLength:
+            if (addNumberByte(data[pos++])) {
+                if (static_cast<int>(number) < 0) {
+                    throw std::runtime_error("Negative string length");
+                }
+                string.clear();
+                string.reserve(std::min<std::size_t>(number, max_reserve));
+                stringRemaining = number;
+                state = State::StringBody;
+            }
+            break;
+        case State::StringBody: {
+            std::size_t n = std::min(stringRemaining, data.size() - pos);
+            string.append(reinterpret_cast<const char *>(data.data() + pos), n);
+            pos += n;
+            stringRemaining -= n;
+            break;
+        }
+        }
+
+        /* An empty string has no body, so this is checked outside the switch */
+        if (state == State::StringBody && stringRemaining == 0) {
+            if (compressed) {
+                params.push_back(Param(Protocol::PAR_STRING, zstring::decompress(string, originalLength)));
+            } else {
+                params.push_back(Param(Protocol::PAR_STRING, std::move(string)));
+                string = std::string();
+            }
+            state = State::ParamType;
+        }
+    }
+}
+
+bool CommandDecoder::inProgress() const { return state != State::CommandType || batchRemaining > 0; }
+
+void CommandDecoder::complete(std::vector<Command> &commands) {
+    if (commandType != Protocol::COM_BATCH) {
+        auto &to = batchRemaining > 0 ? batch : commands;
+        to.emplace_back(commandType, std::move(params));
+        params = std::vector<Param>();
+        codec::checkRequest(schema::Commands{}, to.back());
+        if (batchRemaining > 0 && --batchRemaining == 0) {
+            commands.emplace_back(Protocol::COM_BATCH, std::vector<Param>());
+            commands.back().batch = std::move(batch);
+            batch = std::vector<Command>();
+        }
+        return;
+    }
+
+    if (batchRemaining > 0) {
+        throw std::runtime_error("Batch inside a batch");
+    }
+    if (params.size() != 1 || params[0].paramType != Protocol::PAR_NUM) {
+        throw std::runtime_error("Batch without a command count");
+    }
+    int count = params[0].getInt();
+    if (count < 0 || count > max_batch) {
+        throw std::runtime_error("Wrong number of commands in batch");
+    }
+    params.clear();
+    if (count == 0) {
+        commands.emplace_back(Protocol::COM_BATCH, std::vector<Param>());
+    } else {
+        batch.reserve(std::min(count, 1024));
+        batchRemaining = count;
+    }
+}
+
+bool CommandDecoder::addNumberByte(unsigned char byte) {
+    number = (numberBytes == 0 ? 0 : number << 8) | byte;
+    if (++numberBytes < 4) {
+        return false;
+    }
+    numberBytes = 0;
+    return true;
+}
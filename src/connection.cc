@@ -29,19 +29,24 @@
 
 #include "connectionclosedexception.h"
 
+#include <algorithm>   /* min() */
 #include <arpa/inet.h> /* htons() */
 #include <csignal>     /* signal() */
+#include <cerrno>      /* errno, EINTR */
 #include <cstdlib>     /* exit() */
+#include <climits>     /* IOV_MAX */
 #include <cstring>     /* memcpy() */
 #include <iostream>
-#include <netdb.h>      /* gethostbyname() */
+#include <netdb.h>      /* getaddrinfo() */
 #include <netinet/in.h> /* sockaddr_in */
-#include <sys/socket.h> /* socket(), connect() */
+#include <poll.h>       /* poll() */
+#include <sys/sendfile.h> /* sendfile() */
+#include <sys/socket.h> /* socket(), connect(), recv() */
 #include <sys/types.h>  /* socket(), connect(), read(), write() */
-#include <sys/uio.h>    /* read(), write() */
+#include <sys/uio.h>    /* read(), write(), writev() */
 #include <unistd.h>     /* close(), read(), write() */
 
-bool Connection::ignoresPipeSignals = false;
+std::atomic<bool> Connection::ignoresPipeSignals{false};
 
 Connection::Connection() {
     /*
@@ -51,9 +56,8 @@ Connection::Connection() {
      * of written bytes. Connection::write() tests for this and
      * throws ConnectionClosedException when it happens.
      */
-    if (!ignoresPipeSignals) {
+    if (!ignoresPipeSignals.exchange(true)) {
         signal(SIGPIPE, SIG_IGN);
-        ignoresPipeSignals = true;
     }
 }
 
@@ -64,25 +68,35 @@ Connection::Connection(const char *host, int port) : Connection() {
         return;
     }
 
-    sockaddr_in server;
-    server.sin_family = AF_INET;
-    hostent *hp = gethostbyname(host);
-    if (hp == 0) {
+    /* getaddrinfo() instead of gethostbyname(), which is not thread safe */
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *hp = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &hp) != 0) {
+        close(my_socket);
         my_socket = no_socket;
         return;
     }
 
-    memcpy(reinterpret_cast<char *>(&server.sin_addr),
-           reinterpret_cast<char *>(hp->h_addr), hp->h_length);
+    sockaddr_in server;
+    memcpy(&server, hp->ai_addr, sizeof(server));
+    freeaddrinfo(hp);
     server.sin_port = htons(port);
     if (connect(my_socket, reinterpret_cast<sockaddr *>(&server),
                 sizeof(server)) < 0) {
+        close(my_socket);
         my_socket = no_socket;
     }
 }
 
-Connection::Connection(Connection &&o) : my_socket{o.my_socket} {
+Connection::Connection(Connection &&o)
+    : my_socket{o.my_socket}, read_buffer(std::move(o.read_buffer)),
+      read_pos{o.read_pos}, read_end{o.read_end},
+      write_buffer(std::move(o.write_buffer)),
+      implicit_flush{o.implicit_flush}, features{o.features.load()} {
     o.my_socket = no_socket;
+    o.read_pos = o.read_end = 0;
 }
 
 Connection::~Connection() {
@@ -93,34 +107,320 @@ Connection::~Connection() {
 
 bool Connection::isConnected() const { return my_socket != no_socket; }
 
+int Connection::getFeatures() const { return features.load(std::memory_order_relaxed); }
+
+void Connection::setFeatures(int agreed) const { features.store(agreed, std::memory_order_relaxed); }
+
 void Connection::write(unsigned char ch) const {
     // std::cout << "Writing " << static_cast<int>(ch) << std::endl;
     if (my_socket == no_socket) {
         error("Write attempted on a not properly opened connection");
     }
-    int count = ::write(my_socket, &ch, 1);
-    if (count != 1) {
-        throw ConnectionClosedException();
+    write_buffer.push_back(ch);
+    if (implicit_flush && write_buffer.size() >= buffer_size) {
+        flush();
     }
 }
 
+void Connection::writeAll(std::span<const std::byte> data) const {
+    if (my_socket == no_socket) {
+        error("Write attempted on a not properly opened connection");
+    }
+    auto bytes = reinterpret_cast<const unsigned char *>(data.data());
+    if (!implicit_flush || write_buffer.size() + data.size() < buffer_size) {
+        write_buffer.insert(write_buffer.end(), bytes, bytes + data.size());
+        return;
+    }
+    iovec iov{const_cast<unsigned char *>(bytes), data.size()};
+    sendVector(std::span(&iov, 1));
+}
+
+void Connection::writeAll(const std::string &s) const {
+    writeAll(std::as_bytes(std::span(s.data(), s.size())));
+}
+
+void Connection::writeAll(std::span<const iovec> data) const {
+    if (my_socket == no_socket) {
+        error("Write attempted on a not properly opened connection");
+    }
+    std::size_t total = 0;
+    for (auto &iov : data) {
+        total += iov.iov_len;
+    }
+    if (!implicit_flush || write_buffer.size() + total < buffer_size) {
+        for (auto &iov : data) {
+            auto bytes = static_cast<const unsigned char *>(iov.iov_base);
+            write_buffer.insert(write_buffer.end(), bytes, bytes + iov.iov_len);
+        }
+        return;
+    }
+    sendVector(data);
+}
+
+void Connection::writeFile(int fd, off_t offset, std::size_t length) const {
+    if (my_socket == no_socket) {
+        error("Write attempted on a not properly opened connection");
+    }
+    /* Small ranges, and connections that must not block, go through
+       the buffer */
+    if (!implicit_flush || write_buffer.size() + length < buffer_size) {
+        std::size_t start = write_buffer.size();
+        write_buffer.resize(start + length);
+        std::size_t done = 0;
+        while (done < length) {
+            ssize_t count = ::pread(fd, write_buffer.data() + start + done,
+                                    length - done, offset + done);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                /* The answer cannot be completed, so the connection is
+                   shut down for the client and the server to notice */
+                write_buffer.resize(start);
+                ::shutdown(my_socket, SHUT_RDWR);
+                throw ConnectionClosedException();
+            }
+            done += count;
+        }
+        return;
+    }
+
+    flush();
+    std::size_t sent = 0;
+    while (sent < length) {
+        ssize_t count = ::sendfile(my_socket, fd, &offset, length - sent);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            waitFor(POLLOUT);
+            continue;
+        }
+        if (count <= 0) {
+            /* The client has gone, or the file is shorter than expected;
+               either way the answer cannot be completed */
+            ::shutdown(my_socket, SHUT_RDWR);
+            throw ConnectionClosedException();
+        }
+        sent += count;
+    }
+}
+
+void Connection::flush() const {
+    if (my_socket == no_socket) {
+        error("Flush attempted on a not properly opened connection");
+    }
+    try {
+        sendAll(write_buffer.data(), write_buffer.size());
+    } catch (ConnectionClosedException &) {
+        write_buffer.clear();
+        throw;
+    }
+    write_buffer.clear();
+}
+
+bool Connection::tryFlush() const {
+    if (my_socket == no_socket) {
+        error("Flush attempted on a not properly opened connection");
+    }
+    std::size_t sent = 0;
+    while (sent < write_buffer.size()) {
+        ssize_t count = ::send(my_socket, write_buffer.data() + sent,
+                               write_buffer.size() - sent, MSG_DONTWAIT);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (count <= 0) {
+            write_buffer.clear();
+            throw ConnectionClosedException();
+        }
+        sent += count;
+    }
+    write_buffer.erase(write_buffer.begin(), write_buffer.begin() + sent);
+    return write_buffer.empty();
+}
+
+void Connection::sendAll(const unsigned char *data, std::size_t len) const {
+    std::size_t sent = 0;
+    while (sent < len) {
+        ssize_t count = ::write(my_socket, data + sent, len - sent);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            waitFor(POLLOUT);
+            continue;
+        }
+        if (count <= 0) {
+            throw ConnectionClosedException();
+        }
+        sent += count;
+    }
+}
+
+void Connection::sendVector(std::span<const iovec> data) const {
+    std::vector<iovec> iovs;
+    iovs.reserve(data.size() + 1);
+    if (!write_buffer.empty()) {
+        iovs.push_back({write_buffer.data(), write_buffer.size()});
+    }
+    for (auto &iov : data) {
+        if (iov.iov_len > 0) {
+            iovs.push_back(iov);
+        }
+    }
+
+    std::size_t first = 0;
+    while (first < iovs.size()) {
+        int count = static_cast<int>(std::min<std::size_t>(iovs.size() - first, IOV_MAX));
+        ssize_t sent = ::writev(my_socket, &iovs[first], count);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            waitFor(POLLOUT);
+            continue;
+        }
+        if (sent <= 0) {
+            write_buffer.clear();
+            throw ConnectionClosedException();
+        }
+        /* Skip what has been sent, the first iovec may be partly sent */
+        std::size_t n = sent;
+        while (first < iovs.size() && n >= iovs[first].iov_len) {
+            n -= iovs[first].iov_len;
+            ++first;
+        }
+        if (n > 0) {
+            iovs[first].iov_base = static_cast<char *>(iovs[first].iov_base) + n;
+            iovs[first].iov_len -= n;
+        }
+    }
+    write_buffer.clear();
+}
+
 unsigned char Connection::read() const {
     if (my_socket == no_socket) {
         error("Read attempted on a not properly opened connection");
     }
-    char data;
-    int count = ::read(my_socket, &data, 1);
-    if (count != 1) {
+    if (read_pos == read_end) {
+        fillBuffer();
+    }
+    // std::cout << "Reading " << static_cast<int>(read_buffer[read_pos]) << std::endl;
+    return read_buffer[read_pos++];
+}
+
+void Connection::readExact(std::span<std::byte> buf) const {
+    if (my_socket == no_socket) {
+        error("Read attempted on a not properly opened connection");
+    }
+    auto dest = reinterpret_cast<unsigned char *>(buf.data());
+    std::size_t done = std::min(buf.size(), read_end - read_pos);
+    if (done > 0) {
+        memcpy(dest, read_buffer.data() + read_pos, done);
+        read_pos += done;
+    }
+
+    /* Large remainders are read straight into the destination */
+    while (buf.size() - done >= buffer_size) {
+        ssize_t count = ::read(my_socket, dest + done, buf.size() - done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            waitFor(POLLIN);
+            continue;
+        }
+        if (count <= 0) {
+            throw ConnectionClosedException();
+        }
+        done += count;
+    }
+    while (done < buf.size()) {
+        fillBuffer();
+        std::size_t n = std::min(buf.size() - done, read_end - read_pos);
+        memcpy(dest + done, read_buffer.data() + read_pos, n);
+        read_pos += n;
+        done += n;
+    }
+}
+
+void Connection::readExact(std::string &s, std::size_t n) const {
+    /* n usually comes from the peer, so the string grows with the data
+       that has arrived instead of being allocated in full up front. It
+       at most doubles at a time */
+    s.clear();
+    while (s.size() < n) {
+        std::size_t start = s.size();
+        std::size_t chunk = std::min(n - start, std::max(start, buffer_size * 8));
+        s.resize(start + chunk);
+        readExact(std::as_writable_bytes(std::span(s.data() + start, chunk)));
+    }
+}
+
+void Connection::fillBuffer() const {
+    if (read_buffer.size() < buffer_size) {
+        read_buffer.resize(buffer_size);
+    }
+    ssize_t count;
+    while ((count = ::read(my_socket, read_buffer.data(), read_buffer.size())) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            waitFor(POLLIN);
+        } else if (errno != EINTR) {
+            break;
+        }
+    }
+    if (count <= 0) {
         throw ConnectionClosedException();
     }
-    // std::cout << "Reading " << static_cast<int>(data) << std::endl;
-    return data;
+    read_pos = 0;
+    read_end = count;
+}
+
+std::span<const unsigned char> Connection::readAvailable() const {
+    if (my_socket == no_socket) {
+        error("Read attempted on a not properly opened connection");
+    }
+    if (read_pos == read_end && !receiving) {
+        if (read_buffer.size() < buffer_size) {
+            read_buffer.resize(buffer_size);
+        }
+        ssize_t count;
+        do {
+            count = ::recv(my_socket, read_buffer.data(), read_buffer.size(),
+                           MSG_DONTWAIT);
+        } while (count < 0 && errno == EINTR);
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            count = 0;
+        } else if (count <= 0) {
+            throw ConnectionClosedException();
+        }
+        read_pos = 0;
+        read_end = count;
+    }
+    return std::span<const unsigned char>(read_buffer.data() + read_pos,
+                                          read_end - read_pos);
+}
+
+void Connection::consume(std::size_t n) const {
+    read_pos += std::min(n, read_end - read_pos);
+}
+
+void Connection::waitFor(short events) const {
+    pollfd pfd{my_socket, events, 0};
+    while (::poll(&pfd, 1, -1) < 0 && errno == EINTR) {
+    }
 }
 
 void Connection::initConnection(int s) { my_socket = s; }
 
 int Connection::getSocket() const { return my_socket; }
 
+bool Connection::hasBufferedInput() const { return read_pos != read_end; }
+
 void Connection::error(const char *msg) const {
     std::cerr << "Class Connection: " << msg << std::endl;
     exit(1);
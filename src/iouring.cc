@@ -0,0 +1,182 @@
+// ------------------------------------------------------------------
+//
+//                                 Client/Server communication package
+//
+//                                        IoUring implementation file
+//
+// ------------------------------------------------------------------
+
+#include "iouring.h"
+
+#include <atomic>
+#include <cerrno>       /* errno, EINTR */
+#include <cstring>      /* memset() */
+#include <vector>
+#include <sys/mman.h>   /* mmap(), munmap() */
+#include <sys/syscall.h> /* __NR_io_uring_setup, _enter, _register */
+#include <unistd.h>     /* syscall(), close() */
+
+namespace {
+/* The kernel reads and writes the ring indices concurrently */
+unsigned loadAcquire(unsigned *p) {
+    return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire);
+}
+
+void storeRelease(unsigned *p, unsigned value) {
+    std::atomic_ref<unsigned>(*p).store(value, std::memory_order_release);
+}
+
+template <typename T>
+T *at(void *base, unsigned offset) {
+    return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+}
+}
+
+IoUring::IoUring(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring_fd < 0) {
+        ring_fd = -1;
+        return;
+    }
+    features = params.features;
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_ring_size > sq_ring_size) {
+            sq_ring_size = cq_ring_size;
+        }
+        cq_ring_size = sq_ring_size;
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = nullptr;
+        close(ring_fd);
+        ring_fd = -1;
+        return;
+    }
+    if (features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            cq_ring = nullptr;
+            munmap(sq_ring, sq_ring_size);
+            sq_ring = nullptr;
+            close(ring_fd);
+            ring_fd = -1;
+            return;
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *mapped = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (mapped == MAP_FAILED) {
+        if (cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        munmap(sq_ring, sq_ring_size);
+        sq_ring = cq_ring = nullptr;
+        close(ring_fd);
+        ring_fd = -1;
+        return;
+    }
+    sqes = static_cast<io_uring_sqe *>(mapped);
+
+    sq_head = at<unsigned>(sq_ring, params.sq_off.head);
+    sq_tail = at<unsigned>(sq_ring, params.sq_off.tail);
+    sq_mask = at<unsigned>(sq_ring, params.sq_off.ring_mask);
+    sq_entries = at<unsigned>(sq_ring, params.sq_off.ring_entries);
+    sq_array = at<unsigned>(sq_ring, params.sq_off.array);
+    cq_head = at<unsigned>(cq_ring, params.cq_off.head);
+    cq_tail = at<unsigned>(cq_ring, params.cq_off.tail);
+    cq_mask = at<unsigned>(cq_ring, params.cq_off.ring_mask);
+    cqes = at<io_uring_cqe>(cq_ring, params.cq_off.cqes);
+
+    /* The probe is followed by one entry per possible opcode */
+    constexpr unsigned probe_ops = 256;
+    std::vector<unsigned char> probe_buffer(
+        sizeof(io_uring_probe) + probe_ops * sizeof(io_uring_probe_op));
+    auto *probe = reinterpret_cast<io_uring_probe *>(probe_buffer.data());
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE,
+                probe, probe_ops) == 0) {
+        for (unsigned i = 0; i < probe->ops_len && i < probe_ops; ++i) {
+            if (probe->ops[i].flags & IO_URING_OP_SUPPORTED) {
+                supported_ops.set(probe->ops[i].op);
+            }
+        }
+    }
+}
+
+IoUring::~IoUring() {
+    if (ring_fd < 0) {
+        return;
+    }
+    munmap(sqes, sqes_size);
+    if (cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    munmap(sq_ring, sq_ring_size);
+    close(ring_fd);
+}
+
+bool IoUring::isReady() const { return ring_fd >= 0; }
+
+bool IoUring::hasFeature(unsigned feature) const {
+    return (features & feature) == feature;
+}
+
+bool IoUring::supportsOp(unsigned op) const {
+    return op < supported_ops.size() && supported_ops.test(op);
+}
+
+io_uring_sqe *IoUring::getSqe() {
+    unsigned head = loadAcquire(sq_head);
+    unsigned tail = *sq_tail + to_submit;
+    if (tail - head >= *sq_entries) {
+        return nullptr;
+    }
+    unsigned index = tail & *sq_mask;
+    io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    ++to_submit;
+    return sqe;
+}
+
+bool IoUring::submit(unsigned wait_for) {
+    /* Publish the new entries before the kernel looks at them */
+    storeRelease(sq_tail, *sq_tail + to_submit);
+    to_submit = 0;
+
+    while (true) {
+        /* Entries the kernel has not consumed yet, e.g. after EINTR */
+        unsigned submitting = *sq_tail - loadAcquire(sq_head);
+        long ret = syscall(__NR_io_uring_enter, ring_fd, submitting, wait_for,
+                           wait_for > 0 ? IORING_ENTER_GETEVENTS : 0,
+                           nullptr, 0);
+        /* EBUSY: the completion queue is full and must be reaped first */
+        if (ret >= 0 || errno == EBUSY) {
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool IoUring::nextCompletion(io_uring_cqe &cqe) {
+    unsigned head = *cq_head;
+    if (head == loadAcquire(cq_tail)) {
+        return false;
+    }
+    cqe = cqes[head & *cq_mask];
+    storeRelease(cq_head, head + 1);
+    return true;
+}
@@ -0,0 +1,205 @@
+#include "newsclient.h"
+
+#include "connectionclosedexception.h"
+#include "zstring.h"
+
+#include <span>
+#include <stdexcept>
+
+NewsClient::NewsClient(const char *host, int port) : conn(host, port) {
+    if (conn.isConnected()) {
+        reader = std::thread(&NewsClient::readAnswers, this);
+    }
+}
+
+NewsClient::~NewsClient() {
+    if (conn.isConnected()) {
+        try {
+            flush();
+        } catch (ConnectionClosedException &) {
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    answers_expected.notify_one();
+    if (reader.joinable()) {
+        reader.join();
+    }
+}
+
+bool NewsClient::isConnected() const { return conn.isConnected(); }
+
+void NewsClient::flush() {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    conn.flush();
+}
+
+void NewsClient::readAnswers() {
+    while (true) {
+        std::function<void()> read;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            answers_expected.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) {
+                return;
+            }
+            read = pending.front().read;
+        }
+        try {
+            read();
+        } catch (...) {
+            /* The rest of the stream cannot be trusted */
+            std::lock_guard<std::mutex> lock(mutex);
+            broken = std::current_exception();
+            for (auto &p : pending) {
+                p.fail(broken);
+            }
+            pending.clear();
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.pop_front();
+    }
+}
+
+void NewsClient::Writer::command(Protocol code) { conn.write(static_cast<unsigned char>(code)); }
+
+void NewsClient::Writer::number(int value) {
+    command(Protocol::PAR_NUM);
+    conn.write((value >> 24) & 0xFF);
+    conn.write((value >> 16) & 0xFF);
+    conn.write((value >> 8) & 0xFF);
+    conn.write(value & 0xFF);
+}
+
+void NewsClient::Writer::string(std::string_view s) {
+    command(Protocol::PAR_STRING);
+    length(s.size());
+    conn.writeAll(std::as_bytes(std::span(s)));
+}
+
+void NewsClient::Writer::text(std::string_view s) {
+    std::optional<std::string> compressed;
+    if ((conn.getFeatures() & feature::compression) != 0 && s.size() >= zstring::threshold) {
+        compressed = zstring::compress(s);
+    }
+    if (!compressed.has_value()) {
+        string(s);
+        return;
+    }
+    command(Protocol::PAR_ZSTRING);
+    length(s.size());
+    length(compressed->size());
+    conn.writeAll(*compressed);
+}
+
+void NewsClient::Writer::length(std::size_t n) {
+    conn.write((n >> 24) & 0xFF);
+    conn.write((n >> 16) & 0xFF);
+    conn.write((n >> 8) & 0xFF);
+    conn.write(n & 0xFF);
+}
+
+Protocol NewsClient::Reader::code() { return static_cast<Protocol>(conn.read()); }
+
+int NewsClient::Reader::number() {
+    codec::expectCode(*this, Protocol::PAR_NUM);
+    std::byte bytes[4];
+    conn.readExact(bytes);
+    return (std::to_integer<int>(bytes[0]) << 24) | (std::to_integer<int>(bytes[1]) << 16) |
+           (std::to_integer<int>(bytes[2]) << 8) | std::to_integer<int>(bytes[3]);
+}
+
+std::string NewsClient::Reader::string() {
+    Protocol type = code();
+    if (type != Protocol::PAR_STRING && type != Protocol::PAR_ZSTRING) {
+        throw std::runtime_error("Expected a string, got " + std::to_string(static_cast<int>(type)));
+    }
+    std::size_t original = 0;
+    if (type == Protocol::PAR_ZSTRING) {
+        original = length();
+    }
+    std::string s;
+    conn.readExact(s, length());
+    if (type == Protocol::PAR_ZSTRING) {
+        return zstring::decompress(s, original);
+    }
+    return s;
+}
+
+std::size_t NewsClient::Reader::length() {
+    std::byte bytes[4];
+    conn.readExact(bytes);
+    int n = (std::to_integer<int>(bytes[0]) << 24) | (std::to_integer<int>(bytes[1]) << 16) |
+            (std::to_integer<int>(bytes[2]) << 8) | std::to_integer<int>(bytes[3]);
+    if (n < 0) {
+        throw std::runtime_error("Negative string length " + std::to_string(n));
+    }
+    return n;
+}
+
+std::future<int> NewsClient::hello(int wanted) {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    Writer out{conn};
+    codec::encodeRequest<schema::Hello>(out, protocol_version, wanted);
+    return expect<int>([this] {
+        Reader in{conn};
+        auto [version, agreed] = codec::decodeAnswer<schema::Hello>(in);
+        if (version < 1 || version > protocol_version) {
+            throw std::runtime_error("Unknown protocol version " + std::to_string(version));
+        }
+        conn.setFeatures(agreed);
+        return agreed;
+    });
+}
+
+int NewsClient::features() const { return conn.getFeatures(); }
+
+std::future<NewsClient::Newsgroups> NewsClient::listNewsgroups() { return request<schema::ListNewsgroups>(); }
+
+std::future<bool> NewsClient::createNewsgroup(std::string_view name) {
+    return request<schema::CreateNewsgroup>(name);
+}
+
+std::future<bool> NewsClient::deleteNewsgroup(int id) { return request<schema::DeleteNewsgroup>(id); }
+
+std::future<std::optional<NewsClient::Articles>> NewsClient::listArticles(int newsgroupId) {
+    return request<schema::ListArticles>(newsgroupId, std::optional<int>(), std::optional<int>());
+}
+
+std::future<std::optional<NewsClient::Articles>> NewsClient::listArticles(int newsgroupId, std::optional<int> afterId,
+                                                                          int limit) {
+    return request<schema::ListArticles>(newsgroupId, std::optional(limit), afterId);
+}
+
+std::future<bool> NewsClient::createArticle(int newsgroupId, std::string_view title, std::string_view author,
+                                            std::string_view text) {
+    return request<schema::CreateArticle>(newsgroupId, title, author, text);
+}
+
+std::future<bool> NewsClient::deleteArticle(int newsgroupId, int articleId) {
+    return request<schema::DeleteArticle>(newsgroupId, articleId);
+}
+
+std::future<NewsClient::Article> NewsClient::getArticle(int newsgroupId, int articleId) {
+    return request<schema::GetArticle>(newsgroupId, articleId);
+}
+
+std::future<NewsClient::FetchedArticle> NewsClient::getArticleIfModified(int newsgroupId, int articleId,
+                                                                         int knownVersion) {
+    return request<schema::GetArticleIf>(newsgroupId, articleId, knownVersion);
+}
+
+std::future<std::vector<bool>> NewsClient::createArticles(int newsgroupId, const std::vector<NewArticle> &articles) {
+    return batch<schema::CreateArticle>(articles, [newsgroupId](const NewArticle &article) {
+        return std::tuple<int, const std::string &, const std::string &, const std::string &>(
+            newsgroupId, std::get<0>(article), std::get<1>(article), std::get<2>(article));
+    });
+}
+
+std::future<std::vector<NewsClient::Article>> NewsClient::getArticles(int newsgroupId,
+                                                                      const std::vector<int> &articleIds) {
+    return batch<schema::GetArticle>(articleIds, [newsgroupId](int id) { return std::tuple(newsgroupId, id); });
+}
@@ -0,0 +1,123 @@
+#include "replybuilder.h"
+
+#include "zstring.h"
+
+#include <utility>
+
+void ReplyBuilder::command(Protocol code) {
+    buffer.push_back(static_cast<unsigned char>(code));
+}
+
+void ReplyBuilder::appendNumber(std::size_t n) {
+    buffer.push_back((n >> 24) & 0xFF);
+    buffer.push_back((n >> 16) & 0xFF);
+    buffer.push_back((n >> 8) & 0xFF);
+    buffer.push_back(n & 0xFF);
+}
+
+void ReplyBuilder::number(int value) {
+    command(Protocol::PAR_NUM);
+    appendNumber(static_cast<unsigned int>(value));
+}
+
+void ReplyBuilder::string(std::string_view s) {
+    command(Protocol::PAR_STRING);
+    appendNumber(s.size());
+    buffer.insert(buffer.end(), s.begin(), s.end());
+}
+
+void ReplyBuilder::string(std::string &&s) {
+    command(Protocol::PAR_STRING);
+    appendNumber(s.size());
+    appendBody(std::move(s));
+}
+
+void ReplyBuilder::appendBody(std::string &&s) {
+    if (s.size() < copy_limit) {
+        buffer.insert(buffer.end(), s.begin(), s.end());
+        return;
+    }
+    pieces.push_back({buffer.size(), bodies.size(), -1, 0, s.size()});
+    bodies.push_back(std::move(s));
+}
+
+void ReplyBuilder::string(const FileRange &range) {
+    command(Protocol::PAR_STRING);
+    appendNumber(range.length);
+    pieces.push_back({buffer.size(), 0, range.fd, range.offset, range.length});
+}
+
+void ReplyBuilder::text(std::string_view s) {
+    if (!appendCompressed(s)) {
+        string(s);
+    }
+}
+
+void ReplyBuilder::text(std::string &&s) {
+    if (!appendCompressed(s)) {
+        string(std::move(s));
+    }
+}
+
+void ReplyBuilder::text(const FileRange &range) { string(range); }
+
+void ReplyBuilder::setCompression(bool on) { compressing = on; }
+
+bool ReplyBuilder::appendCompressed(std::string_view s) {
+    if (!compressing || s.size() < zstring::threshold) {
+        return false;
+    }
+    auto compressed = zstring::compress(s);
+    if (!compressed.has_value()) {
+        return false;
+    }
+    command(Protocol::PAR_ZSTRING);
+    appendNumber(s.size());
+    appendNumber(compressed->size());
+    appendBody(std::move(*compressed));
+    return true;
+}
+
+std::size_t ReplyBuilder::size() const {
+    std::size_t total = buffer.size();
+    for (auto &piece : pieces) {
+        total += piece.length;
+    }
+    return total;
+}
+
+void ReplyBuilder::writeTo(const Connection &conn) {
+    /* The answer is dropped also if the connection fails, so that it is
+       not sent again, in part, when the builder is reused */
+    try {
+        iovecs.clear();
+        std::size_t pos = 0;
+        for (auto &piece : pieces) {
+            if (piece.at > pos) {
+                iovecs.push_back({buffer.data() + pos, piece.at - pos});
+                pos = piece.at;
+            }
+            if (piece.fd < 0) {
+                iovecs.push_back({bodies[piece.body].data(), piece.length});
+            } else {
+                conn.writeAll(iovecs);
+                iovecs.clear();
+                conn.writeFile(piece.fd, piece.offset, piece.length);
+            }
+        }
+        if (buffer.size() > pos) {
+            iovecs.push_back({buffer.data() + pos, buffer.size() - pos});
+        }
+        conn.writeAll(iovecs);
+    } catch (...) {
+        clear();
+        throw;
+    }
+    clear();
+}
+
+void ReplyBuilder::clear() {
+    buffer.clear();
+    bodies.clear();
+    pieces.clear();
+}
@@ -32,19 +32,35 @@
 #include <arpa/inet.h> /* htons(), ntohs() */
 #include <iostream>
 #include <memory>
+#include <cerrno>      /* errno, EINTR */
+#include <chrono>
+#include <cstdint>
+#include <cstring>     /* strerror() */
+#include <fcntl.h>      /* fcntl() */
 #include <netinet/in.h> /* sockaddr_in */
+#include <netinet/tcp.h> /* TCP_NODELAY */
+#include <sys/epoll.h>  /* epoll_create1(), epoll_ctl(), epoll_wait() */
+#include <sys/eventfd.h> /* eventfd() */
 #include <sys/socket.h> /* socket(), bind(), getsockname(), listen() */
-#include <sys/time.h>   /* select() */
-#include <sys/types.h>  /* socket(), bind(), select() */
-#include <unistd.h>     /* close(), select() */
+#include <sys/types.h>  /* socket(), bind() */
+#include <unistd.h>     /* close(), read(), write() */
 
-Server::Server(int port) {
-    my_socket = socket(AF_INET, SOCK_STREAM, 0);
+Server::Server(int port, int backlog, bool reuse_port)
+    : connection_factory([] { return std::make_shared<Connection>(); }) {
+    my_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (my_socket < 0) {
         my_socket = Connection::no_socket;
         return;
     }
 
+    int on = 1;
+    if (reuse_port &&
+        setsockopt(my_socket, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        close(my_socket);
+        my_socket = Connection::no_socket;
+        return;
+    }
+
     sockaddr_in server;
     server.sin_family = AF_INET;
     server.sin_addr.s_addr = INADDR_ANY;
@@ -67,72 +83,310 @@ Server::Server(int port) {
         return;
     }
 
-    listen(my_socket, 5);
+    if (listen(my_socket, backlog) < 0) {
+        close(my_socket);
+        my_socket = Connection::no_socket;
+        return;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = my_socket;
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, my_socket, &ev) < 0) {
+        close(my_socket);
+        my_socket = Connection::no_socket;
+        return;
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev.data.fd = wake_fd;
+    if (wake_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) < 0) {
+        close(my_socket);
+        my_socket = Connection::no_socket;
+    }
 }
 
 Server::~Server() {
     if (my_socket != Connection::no_socket) {
         close(my_socket);
     }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+    }
     my_socket = Connection::no_socket;
 }
 
 bool Server::isReady() const { return my_socket != Connection::no_socket; }
 
-std::shared_ptr<Connection> Server::waitForActivity() const {
+std::shared_ptr<Connection> Server::waitForActivity() {
     if (my_socket == Connection::no_socket) {
         error("waitForActivity: server not opened");
     }
 
-    fd_set read_template;
-    FD_ZERO(&read_template);
-    FD_SET(my_socket, &read_template);
-    for (const auto &conn : connections) {
-        FD_SET(conn->getSocket(), &read_template);
+    std::shared_ptr<Connection> conn;
+    do {
+        poll();
+    } while (!nextActivity(conn));
+    return conn;
+}
+
+std::vector<std::shared_ptr<Connection>> Server::waitForActivities() {
+    if (my_socket == Connection::no_socket) {
+        error("waitForActivities: server not opened");
+    }
+
+    std::vector<std::shared_ptr<Connection>> result;
+    while (result.empty()) {
+        poll();
+        std::shared_ptr<Connection> conn;
+        while (!ready_sockets.empty()) {
+            if (nextActivity(conn)) {
+                result.push_back(conn);
+            }
+        }
+    }
+    return result;
+}
+
+void Server::poll() {
+    if (!ready_sockets.empty()) {
+        return;
     }
 
-    std::shared_ptr<Connection> return_conn;
-    select(FD_SETSIZE, &read_template, 0, 0, 0);
-    if (FD_ISSET(my_socket, &read_template)) {
-        int new_socket = accept(my_socket, 0, 0);
-        if (new_socket == -1) {
-            error("waitForActivity: accept returned error");
+    /* epoll cannot see data that is already in a connection's buffer */
+    for (int s : returned_sockets) {
+        auto it = connections.find(s);
+        if (it != connections.end() && it->second->hasBufferedInput() &&
+            paused_sockets.count(s) == 0) {
+            ready_sockets.push_back(s);
         }
-        if (pending_socket != Connection::no_socket) {
-            error("waitForActivity: a previous connection is waiting to be registered");
+    }
+    returned_sockets.clear();
+
+    /* Don't block if buffered connections are waiting, but still give
+       the other sockets a chance to be served. While accepting is
+       paused, wake up in time to retry it */
+    epoll_event events[max_events];
+    int n;
+    do {
+        int timeout = ready_sockets.empty() ? -1 : 0;
+        if (accept_paused && timeout != 0) {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(
+                accept_retry - std::chrono::steady_clock::now());
+            timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(left.count(), 0));
         }
-        pending_socket = new_socket;
-        return_conn = nullptr;
-    } else {
-        auto it = find_if(connections.begin(), connections.end(),
-                          [&](const std::shared_ptr<Connection> &conn) {
-                              return FD_ISSET(conn->getSocket(),
-                                              &read_template);
-                          });
-        if (it == connections.end()) {
-            error("waitForActivity: could not find registered connection");
+        n = epoll_wait(epoll_fd, events, max_events, timeout);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        error("waitForActivity: epoll_wait returned error");
+    }
+    if (accept_paused && std::chrono::steady_clock::now() >= accept_retry) {
+        resumeAccepting();
+    }
+    /* epoll reports each socket once, so it can only repeat one of the
+       buffered connections queued above */
+    std::unordered_set<int> buffered(ready_sockets.begin(), ready_sockets.end());
+    for (int i = 0; i < n; ++i) {
+        int s = events[i].data.fd;
+        if (buffered.count(s) == 0) {
+            ready_sockets.push_back(s);
+        }
+    }
+}
+
+bool Server::nextActivity(std::shared_ptr<Connection> &conn) {
+    int s = ready_sockets.front();
+    ready_sockets.pop_front();
+
+    if (s == my_socket) {
+        acceptAll();
+        return false;
+    }
+    if (s == wake_fd) {
+        runPosted();
+        return false;
+    }
+
+    auto it = connections.find(s);
+    if (it == connections.end()) {
+        return false;
+    }
+    returned_sockets.push_back(s);
+    conn = it->second;
+    return true;
+}
+
+void Server::acceptAll() {
+    while (true) {
+        /* The event loop must never block on a client, so the reads and
+           writes of a Connection wait with poll() instead */
+        int new_socket = accept4(my_socket, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (new_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                /* E.g. out of descriptors. The listening socket would be
+                   reported as ready again at once, so it is not watched
+                   until the server has a chance of accepting again */
+                std::cerr << "Class Server::acceptAll: accept returned error: "
+                          << strerror(errno) << std::endl;
+                pauseAccepting();
+            }
+            return;
         }
-        return_conn = *it;
+        auto conn = connection_factory();
+        if (conn->getSocket() != Connection::no_socket) {
+            error("acceptAll: connection factory returned a busy connection");
+        }
+        conn->initConnection(new_socket);
+        addConnection(conn);
+    }
+}
+
+void Server::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex);
+        posted.push_back(std::move(task));
+    }
+    std::uint64_t one = 1;
+    while (::write(wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+void Server::runPosted() {
+    std::uint64_t count;
+    while (::read(wake_fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex);
+        tasks.swap(posted);
+    }
+    for (auto &task : tasks) {
+        task();
     }
-    return return_conn;
+}
+
+void Server::pauseAccepting() {
+    accept_retry = std::chrono::steady_clock::now() + accept_retry_delay;
+    if (!accept_paused) {
+        accept_paused = true;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, my_socket, nullptr);
+    }
+}
+
+void Server::resumeAccepting() {
+    if (!accept_paused) {
+        return;
+    }
+    accept_paused = false;
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = my_socket;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, my_socket, &ev) < 0) {
+        error("resumeAccepting: epoll_ctl returned error");
+    }
+}
+
+void Server::setConnectionFactory(std::function<std::shared_ptr<Connection>()> factory) {
+    connection_factory = std::move(factory);
 }
 
 void Server::registerConnection(const std::shared_ptr<Connection> &conn) {
-    if (conn->getSocket() != Connection::no_socket) {
-        error("registerConnection: connection is busy");
+    int s = conn->getSocket();
+    if (s == Connection::no_socket) {
+        error("registerConnection: connection is not open");
     }
-    if (pending_socket == Connection::no_socket) {
-        error("registerConnection: no client is trying to connect");
+    if (fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) < 0) {
+        error("registerConnection: fcntl returned error");
     }
-    conn->initConnection(pending_socket);
-    connections.push_back(conn);
-    pending_socket = Connection::no_socket;
+    addConnection(conn);
+}
+
+void Server::addConnection(const std::shared_ptr<Connection> &conn) {
+    /* Answers are flushed whole, so Nagle's algorithm would only delay
+       them. Fails harmlessly for sockets that are not TCP */
+    int on = 1;
+    setsockopt(conn->getSocket(), IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    connections[conn->getSocket()] = conn;
+    watch(conn);
 }
 
 void Server::deregisterConnection(const std::shared_ptr<Connection> &conn) {
-    connections.erase(
-        std::remove(connections.begin(), connections.end(), conn),
-        connections.end());
+    auto it = connections.find(conn->getSocket());
+    if (it == connections.end() || it->second != conn) {
+        return;
+    }
+    unwatch(conn);
+    writable_sockets.erase(conn->getSocket());
+    paused_sockets.erase(conn->getSocket());
+    connections.erase(it);
+    /* The connection's descriptor may be closed now, so new clients
+       may be accepted again */
+    resumeAccepting();
+}
+
+void Server::watch(const std::shared_ptr<Connection> &conn) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = conn->getSocket();
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->getSocket(), &ev) < 0) {
+        error("registerConnection: epoll_ctl returned error");
+    }
+}
+
+void Server::watchWritable(const std::shared_ptr<Connection> &conn, bool on) {
+    /* Like pauseReading(), this may be called from a posted task */
+    auto it = connections.find(conn->getSocket());
+    if (it == connections.end() || it->second != conn) {
+        return;
+    }
+    if (on) {
+        writable_sockets.insert(conn->getSocket());
+    } else {
+        writable_sockets.erase(conn->getSocket());
+    }
+    updateInterest(conn);
+}
+
+void Server::pauseReading(const std::shared_ptr<Connection> &conn, bool on) {
+    /* A posted task may refer to a connection that has been
+       deregistered meanwhile */
+    auto it = connections.find(conn->getSocket());
+    if (it == connections.end() || it->second != conn) {
+        return;
+    }
+    if (on) {
+        paused_sockets.insert(conn->getSocket());
+    } else {
+        paused_sockets.erase(conn->getSocket());
+    }
+    updateInterest(conn);
+}
+
+void Server::updateInterest(const std::shared_ptr<Connection> &conn) {
+    int s = conn->getSocket();
+    epoll_event ev{};
+    ev.events = 0;
+    if (paused_sockets.count(s) == 0) {
+        ev.events |= EPOLLIN;
+    }
+    if (writable_sockets.count(s) != 0) {
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.fd = s;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s, &ev) < 0) {
+        error("updateInterest: epoll_ctl returned error");
+    }
+}
+
+void Server::unwatch(const std::shared_ptr<Connection> &conn) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->getSocket(), nullptr);
 }
 
 void Server::error(const char *msg) const {
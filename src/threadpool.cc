@@ -0,0 +1,58 @@
+// ------------------------------------------------------------------
+//
+//                                 Client/Server communication package
+//
+//                                     ThreadPool implementation file
+//
+// ------------------------------------------------------------------
+
+#include "threadpool.h"
+
+#include <utility>
+
+ThreadPool::ThreadPool(std::size_t threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    workers.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this] { run(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    available.notify_one();
+}
+
+std::size_t ThreadPool::size() const { return workers.size(); }
+
+void ThreadPool::run() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
@@ -0,0 +1,325 @@
+// ------------------------------------------------------------------
+//
+//                                 Client/Server communication package
+//
+//                                    UringServer implementation file
+//
+// ------------------------------------------------------------------
+
+#include "uringserver.h"
+
+#include "connection.h"
+
+#include <algorithm>
+#include <cerrno>       /* ECANCELED, EINVAL */
+#include <chrono>
+#include <cstring>      /* strerror() */
+#include <iostream>
+#include <poll.h>       /* POLLIN, POLLOUT */
+#include <sys/socket.h> /* SOCK_NONBLOCK, SOCK_CLOEXEC */
+#include <unistd.h>     /* close() */
+
+UringServer::UringServer(int port, int backlog, bool reuse_port)
+    : Server(port, backlog, reuse_port), ring(ring_entries) {
+    /* The ring replaces the epoll instance made by Server */
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = Connection::no_socket;
+    }
+    bool supported = ring.isReady() && ring.hasFeature(IORING_FEAT_NODROP);
+    for (unsigned op : required_ops) {
+        supported = supported && ring.supportsOp(op);
+    }
+    if (!supported) {
+        if (my_socket != Connection::no_socket) {
+            close(my_socket);
+        }
+        my_socket = Connection::no_socket;
+        return;
+    }
+    if (my_socket != Connection::no_socket) {
+        submitAccept();
+        submitWake();
+    }
+}
+
+UringServer::~UringServer() {
+    if (!ring.isReady()) {
+        return;
+    }
+    /* The kernel may still write into the buffers of the connections
+       being read, so cancel everything and wait until it is done */
+    stopping = true;
+    if (accepting) {
+        submitCancel(Op::Accept, nullptr);
+    }
+    if (timing) {
+        submitCancel(Op::Timeout, nullptr);
+    }
+    for (auto &r : reading) {
+        submitCancel(Op::Recv, r.first);
+    }
+    while ((accepting || timing || !reading.empty()) && ring.submit(1)) {
+        io_uring_cqe cqe;
+        while (ring.nextCompletion(cqe)) {
+            complete(cqe);
+        }
+    }
+}
+
+std::uint64_t UringServer::userData(Op op, const Connection *conn) {
+    static_assert(alignof(Connection) > op_mask, "no room for Op in user_data");
+    return reinterpret_cast<std::uintptr_t>(conn) | static_cast<std::uint64_t>(op);
+}
+
+io_uring_sqe *UringServer::nextSqe() {
+    io_uring_sqe *sqe = ring.getSqe();
+    if (sqe == nullptr) {
+        if (!ring.submit(0)) {
+            error("poll: io_uring_enter returned error");
+        }
+        sqe = ring.getSqe();
+    }
+    return sqe;
+}
+
+void UringServer::submitAccept() {
+    io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = my_socket;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    if (multishot_accept) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    }
+    sqe->user_data = userData(Op::Accept, nullptr);
+    accepting = true;
+}
+
+void UringServer::submitWake() {
+    io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = userData(Op::Wake, nullptr);
+}
+
+void UringServer::submitTimeout() {
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(accept_retry_delay);
+    accept_timeout.tv_sec = seconds.count();
+    accept_timeout.tv_nsec = std::chrono::nanoseconds(accept_retry_delay - seconds).count();
+    io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<std::uint64_t>(&accept_timeout);
+    sqe->len = 1;
+    sqe->user_data = userData(Op::Timeout, nullptr);
+    timing = true;
+}
+
+void UringServer::pauseAccepting() {
+    if (accept_paused) {
+        return;
+    }
+    accept_paused = true;
+    /* A multishot accept may still be armed */
+    if (accepting) {
+        submitCancel(Op::Accept, nullptr);
+    }
+    if (!timing) {
+        submitTimeout();
+    }
+}
+
+void UringServer::resumeAccepting() {
+    if (!accept_paused) {
+        return;
+    }
+    accept_paused = false;
+    if (!accepting && !stopping) {
+        submitAccept();
+    }
+}
+
+void UringServer::submitPollOut(const std::shared_ptr<Connection> &conn) {
+    io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = conn->getSocket();
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = userData(Op::PollOut, conn.get());
+    polling[conn.get()] = conn;
+}
+
+void UringServer::submitCancel(Op op, const Connection *conn) {
+    io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData(op, conn);
+    sqe->user_data = userData(Op::Cancel, conn);
+}
+
+void UringServer::watch(const std::shared_ptr<Connection> &conn) {
+    if (reading.count(conn.get()) != 0) {
+        return;
+    }
+    if (conn->read_buffer.size() < Connection::buffer_size) {
+        conn->read_buffer.resize(Connection::buffer_size);
+    }
+    conn->read_pos = conn->read_end = 0;
+
+    io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->getSocket();
+    sqe->addr = reinterpret_cast<std::uint64_t>(conn->read_buffer.data());
+    sqe->len = conn->read_buffer.size();
+    sqe->user_data = userData(Op::Recv, conn.get());
+    reading[conn.get()] = conn;
+    conn->receiving = true;
+}
+
+void UringServer::unwatch(const std::shared_ptr<Connection> &conn) {
+    if (reading.count(conn.get()) != 0) {
+        submitCancel(Op::Recv, conn.get());
+    }
+    if (polling.count(conn.get()) != 0) {
+        submitCancel(Op::PollOut, conn.get());
+    }
+}
+
+void UringServer::updateInterest(const std::shared_ptr<Connection> &conn) {
+    int s = conn->getSocket();
+    if (paused_sockets.count(s) == 0 && !conn->hasBufferedInput()) {
+        watch(conn);
+    }
+    if (writable_sockets.count(s) != 0 && polling.count(conn.get()) == 0) {
+        submitPollOut(conn);
+    }
+}
+
+void UringServer::poll() {
+    if (!ready_sockets.empty()) {
+        return;
+    }
+
+    /* Connections that have been served either still have buffered
+       input or need a new read, unless their reading is paused */
+    for (int s : returned_sockets) {
+        auto it = connections.find(s);
+        if (it == connections.end()) {
+            continue;
+        }
+        if (paused_sockets.count(s) == 0) {
+            if (it->second->hasBufferedInput()) {
+                ready_sockets.push_back(s);
+            } else {
+                watch(it->second);
+            }
+        }
+        if (writable_sockets.count(s) != 0 && polling.count(it->second.get()) == 0) {
+            submitPollOut(it->second);
+        }
+    }
+    returned_sockets.clear();
+
+    /* One system call submits everything queued since the last one and
+       waits for a completion, unless buffered connections are waiting */
+    do {
+        if (!ring.submit(ready_sockets.empty() ? 1 : 0)) {
+            error("poll: io_uring_enter returned error");
+        }
+        io_uring_cqe cqe;
+        while (ring.nextCompletion(cqe)) {
+            complete(cqe);
+        }
+    } while (ready_sockets.empty());
+}
+
+void UringServer::complete(const io_uring_cqe &cqe) {
+    Op op = static_cast<Op>(cqe.user_data & op_mask);
+    auto *key = reinterpret_cast<const Connection *>(cqe.user_data & ~op_mask);
+
+    switch (op) {
+    case Op::Accept:
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            accepting = false;
+        }
+        if (stopping) {
+            if (cqe.res >= 0) {
+                close(cqe.res);
+            }
+        } else if (cqe.res >= 0) {
+            auto conn = connection_factory();
+            if (conn->getSocket() != Connection::no_socket) {
+                error("poll: connection factory returned a busy connection");
+            }
+            conn->initConnection(cqe.res);
+            addConnection(conn);
+        } else if (cqe.res == -EINVAL && multishot_accept) {
+            /* Kernels before 5.19 have no multishot accept */
+            multishot_accept = false;
+        } else if (cqe.res != -ECANCELED) {
+            /* E.g. out of descriptors. A new accept would fail at once,
+               so none is submitted until the server has a chance of
+               accepting again */
+            std::cerr << "Class UringServer::poll: accept returned error: "
+                      << strerror(-cqe.res) << std::endl;
+            pauseAccepting();
+        }
+        if (!accepting && !stopping && !accept_paused) {
+            submitAccept();
+        }
+        break;
+    case Op::Timeout:
+        timing = false;
+        if (!stopping) {
+            resumeAccepting();
+        }
+        break;
+    case Op::Wake:
+        if (!stopping) {
+            runPosted();
+            submitWake();
+        }
+        break;
+    case Op::Recv: {
+        auto it = reading.find(key);
+        if (it == reading.end()) {
+            break;
+        }
+        auto conn = std::move(it->second);
+        reading.erase(it);
+        conn->receiving = false;
+        int s = conn->getSocket();
+        auto registered = connections.find(s);
+        if (stopping || registered == connections.end() ||
+            registered->second != conn || cqe.res == -ECANCELED) {
+            break;
+        }
+        /* On end of file or error the buffer stays empty; the next read
+           by the application then finds out that the client is gone */
+        if (cqe.res > 0) {
+            conn->read_end = cqe.res;
+        }
+        ready_sockets.push_back(s);
+        break;
+    }
+    case Op::PollOut: {
+        auto it = polling.find(key);
+        if (it == polling.end()) {
+            break;
+        }
+        auto conn = std::move(it->second);
+        polling.erase(it);
+        int s = conn->getSocket();
+        auto registered = connections.find(s);
+        if (!stopping && cqe.res > 0 && registered != connections.end() &&
+            registered->second == conn && writable_sockets.count(s) != 0 &&
+            std::find(ready_sockets.begin(), ready_sockets.end(), s) ==
+                ready_sockets.end()) {
+            ready_sockets.push_back(s);
+        }
+        break;
+    }
+    case Op::Cancel:
+        break;
+    }
+}
@@ -0,0 +1,35 @@
+#include "zstring.h"
+
+#include <stdexcept>
+#include <zlib.h>
+
+namespace zstring {
+
+std::optional<std::string> compress(std::string_view s) {
+    /* The fastest level: the server compresses every answer it sends */
+    uLongf size = compressBound(s.size());
+    std::string out(size, '\0');
+    int status = compress2(reinterpret_cast<Bytef *>(out.data()), &size,
+                           reinterpret_cast<const Bytef *>(s.data()), s.size(), Z_BEST_SPEED);
+    if (status != Z_OK || size >= s.size()) {
+        return std::nullopt;
+    }
+    out.resize(size);
+    return out;
+}
+
+std::string decompress(std::string_view data, std::size_t length) {
+    if (length > max_length) {
+        throw std::runtime_error("Compressed string too long: " + std::to_string(length));
+    }
+    std::string out(length, '\0');
+    uLongf size = length;
+    int status = uncompress(reinterpret_cast<Bytef *>(out.data()), &size,
+                            reinterpret_cast<const Bytef *>(data.data()), data.size());
+    if (status != Z_OK || size != length) {
+        throw std::runtime_error("Corrupt compressed string");
+    }
+    return out;
+}
+
+} // namespace zstring